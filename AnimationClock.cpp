@@ -0,0 +1,27 @@
+#include "AnimationClock.h"
+
+void AnimationClock::setRealtime() {
+    _fixed = false;
+    _firstFrame = 0;
+    _started = false;
+}
+
+void AnimationClock::setFixed(double framesPerSecond, uint64_t firstFrame) {
+    _fixed = true;
+    _framesPerSecond = framesPerSecond;
+    _firstFrame = firstFrame;
+}
+
+double AnimationClock::seconds(uint64_t frame) {
+    if (_fixed) {
+        // from the frame number alone, so no error builds up over long captures
+        return static_cast<double>(_firstFrame + frame) / _framesPerSecond;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (!_started) {
+        _start = now;
+        _started = true;
+    }
+    return std::chrono::duration<double, std::chrono::seconds::period>(now - _start).count();
+}
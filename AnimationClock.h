@@ -0,0 +1,29 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Animation time for each drawn frame. In realtime mode it follows the wall
+// clock from the first frame. With a fixed step, frame N is always shown at
+// N * step seconds, however long it took to render, so a capture comes out
+// the same on any machine and frame ranges can be rendered separately.
+class AnimationClock {
+public:
+    void setRealtime();
+    // firstFrame offsets the frame numbers, e.g. for one shard of a longer capture
+    void setFixed(double framesPerSecond, uint64_t firstFrame = 0);
+
+    bool fixed() const { return _fixed; }
+    double framesPerSecond() const { return _framesPerSecond; }
+
+    // seconds of animation for the frame-th frame drawn, counting from 0
+    double seconds(uint64_t frame);
+
+private:
+    bool _fixed = false;
+    double _framesPerSecond = 60.0;
+    uint64_t _firstFrame = 0;
+
+    bool _started = false;
+    std::chrono::steady_clock::time_point _start;
+};
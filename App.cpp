@@ -1,8 +1,14 @@
 #include "App.h"
+#include "MipChain.h"
+#include "PixelConverter.h"
+#include "Shaders.h"
+#include "TaskGraph.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <fstream>
+#include <iomanip>
 #include <sstream>
 #include <limits>
 #include <set>
@@ -13,8 +19,15 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tinyobjloader/tiny_obj_loader.h>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
 
 using std::cout;
 using std::endl;
@@ -25,29 +38,60 @@ using std::string;
 using std::vector;
 
 namespace {
-    std::vector<char> readFile(const std::string& filename) {
-        std::ifstream file(filename, std::ios::ate | std::ios::binary);
-    
-        if (!file.is_open()) {
-            throw std::runtime_error("failed to open file!");
-        }
-
-        auto fileSize = (size_t) file.tellg();
-        vector<char> buffer(fileSize);
-
-        file.seekg(0);
-        file.read(buffer.data(), fileSize);
-        file.close();
+    // high water mark of the process's resident memory
+    size_t peakResidentBytes() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters = {};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        return counters.PeakWorkingSetSize;
+#else
+        rusage usage = {};
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        return static_cast<size_t>(usage.ru_maxrss);
+#else
+        // kilobytes on Linux
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
 
-        return buffer;
+    // nearest rank, sorted has to be in ascending order
+    double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty())
+            return 0.0;
+        auto rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+        return sorted[std::min(std::max(rank, size_t(1)), sorted.size()) - 1];
     }
 }
 
-const int App::_maxFramesInFlight = 2;
+const uint32_t App::_maxUniformObjects = 1024;
 const std::string App::_modelPath = "data/models/soup.obj";
 const std::string App::_texturePath = "data/textures/soup.jpg";
+const std::string App::_compressedTexturePath = "data/textures/soup.ktx2";
+const std::string App::_pipelineCachePath = "pipeline_cache.bin";
 
 void App::run() {
+    Settings.print(cout);
+    cout << endl;
+
+    auto coefficients = YuvCoefficients::make(CaptureMatrix, CaptureFullRange);
+    if (FixedFps > 0) {
+        _clock.setFixed(FixedFps, StartFrame);
+    }
+    _imageWriter.reset(new ImageWriter(Settings.CaptureBackpressure));
+    bool capture = Settings.SaveToFile && InstanceBenchmark.empty();
+    if (capture) {
+        // a fixed step is the capture's real frame rate
+        _imageWriter->open(Capture, CaptureTarget, coefficients, FixedFps > 0 ? static_cast<int>(FixedFps) : 60);
+    }
+    // only the Y4M outputs take planar frames
+    _yuvConverter.Enabled = GpuYuv && capture && (Capture == CaptureFormat::Y4m || Capture == CaptureFormat::Pipe);
+    _yuvConverter.Coefficients = coefficients;
+    _yuvConverter.Flip = CaptureFlip;
+    _profiler.Enabled = !ProfilePath.empty();
+    _gpuTimer.Enabled = _profiler.Enabled;
+    _imageWriter->setProfiler(&_profiler);
     initVulkan();
     mainLoop();
     cleanup();
@@ -60,72 +104,234 @@ void App::initVulkan() {
     auto validationLayers = true;
     #endif
 
-    _appWindow.init();
-    _appInstance.init(_appWindow.InstanceExtensions, validationLayers);
-    _appDevice.init(&_appInstance, _appWindow.Window, _appWindow.DeviceExtensions);
+    // The allocator takes a lock, so any task may allocate device memory. The
+    // uploader and the single-time command pool aren't thread safe and are only
+    // touched on one chain (command pools, targets, uploads, frame resources).
+    // File loading, texture decoding, pipeline compilation and the swapchain
+    // hang off it and overlap with the rest.
+    TaskGraph startup;
+    std::vector<TaskGraph::Task> windowTasks;
+    if (!Headless) {
+        // GLFW wants its window calls on the main thread
+        windowTasks.push_back(startup.add("window", [this] { _appWindow.init(); }, {}, true));
+    }
+    auto device = startup.add("instance and device", [this, validationLayers] {
+        if (Headless) {
+            // no window, no surface and no swapchain extension
+            _appInstance.init({}, validationLayers);
+            _appDevice.init(&_appInstance, nullptr, {});
+        } else {
+            _appInstance.init(_appWindow.InstanceExtensions, validationLayers);
+            _appDevice.init(&_appInstance, _appWindow.Window, _appWindow.DeviceExtensions);
+        }
 
-    _physicalDevice = _appDevice.PhysicalDevice;
-    _graphicsQueue = _appDevice.GraphicsQueue;
-    _presentQueue = _appDevice.PresentQueue;
-    _device = _appDevice.Device;
+        _physicalDevice = _appDevice.PhysicalDevice;
+        _graphicsQueue = _appDevice.GraphicsQueue;
+        _presentQueue = _appDevice.PresentQueue;
+        _device = _appDevice.Device;
+
+        if (Settings.MsaaSamples > 0) {
+            // the largest count the device supports that doesn't exceed the request
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+            VkSampleCountFlags counts = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+            auto samples = VK_SAMPLE_COUNT_1_BIT;
+            for (uint32_t count = 1; count <= Settings.MsaaSamples && count <= static_cast<uint32_t>(_appDevice.DeviceMsaaSamples); count *= 2) {
+                if (counts & count)
+                    samples = static_cast<VkSampleCountFlagBits>(count);
+            }
+            _appDevice.DeviceMsaaSamples = samples;
+        }
 
-    createSwapchain();
-    createImageViews();
-    createRenderPass();
-    createDescriptorSetLayout();
-    createGraphicsPipeline();
-    createCommandPool();
-    createColorResources();
-    createDepthResources();
-    createFramebuffers();
-    createTextureImage();
-    createTextureImageView();
-    createTextureSampler();
-    loadModel();
-    createVertexBuffer();
-    createIndexBuffer();
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSets();
-    createCommandBuffers();
-    createSyncObjects();
+        _allocator.init(_physicalDevice, _device);
+    }, windowTasks, true);
+
+    auto model = startup.add("load model", [this] { loadModel(); });
+    auto shaders = startup.add("read shaders", [this] { loadShaders(); });
+    // waits for the device only to know whether BC textures can be used
+    auto texture = startup.add("load texture", [this] { loadTexture(); }, {device});
+
+    auto pipelineCache = startup.add("pipeline cache", [this] { _pipelineCache.init(_physicalDevice, _device, _pipelineCachePath); }, {device});
+    // decided before the render pass, which has to keep the depth attachment for the pyramid
+    auto culling = startup.add("culling pipelines", [this] {
+        _culling.Enabled = GpuCulling;
+        _culling.Occlusion = OcclusionCulling;
+        _culling.init(&_appDevice, &_allocator, _pipelineCache.Cache, findDepthFormat());
+    }, {pipelineCache});
+    auto swapchain = startup.add("swapchain", [this] {
+        createSwapchain();
+        createImageViews();
+    }, {device}, true);
+    auto renderPass = startup.add("render pass", [this] { createRenderPass(); }, {swapchain, culling});
+    // after the swapchain, which decides whether its images can be sampled
+    auto yuvPipeline = startup.add("yuv pipeline", [this] { _yuvConverter.init(&_appDevice, _pipelineCache.Cache); }, {swapchain, pipelineCache});
+    auto descriptorSetLayout = startup.add("descriptor set layout", [this] { createDescriptorSetLayout(); }, {device});
+    // after the model, whose vertex format sets the vertex input
+    startup.add("graphics pipeline", [this] { createGraphicsPipeline(); }, {renderPass, descriptorSetLayout, shaders, pipelineCache, model});
+
+    auto commands = startup.add("command pools", [this] {
+        createCommandPool();
+        _recorder.Threads = RecordThreads;
+        _recorder.init(_device, _appDevice.DeviceQueueFamilyIndices.graphicsFamily);
+        _uploader.init(&_appDevice, &_allocator);
+        _gpuTimer.init(&_appDevice);
+    }, {culling});
+    auto targets = startup.add("render targets", [this] {
+        createColorResources();
+        createDepthResources();
+        createCullingPyramid();
+        createFramebuffers();
+        createReadbackBuffers();
+    }, {commands, renderPass, yuvPipeline});
+    auto uploads = startup.add("uploads", [this] {
+        createTextureImage();
+        createTextureImageView();
+        createTextureSampler();
+        createVertexBuffer();
+        createIndexBuffer();
+        _culling.setMesh(_meshVertices, _vertexCount, _indexCount);
+        // every upload so far goes out in one submission
+        _uploader.flush();
+        // the GPU copies are all that is needed from here on
+        _meshCache.close();
+        _meshVertices = nullptr;
+        _meshIndices = nullptr;
+    }, {targets, model, texture});
+    startup.add("frame resources", [this] {
+        createUniformBuffers();
+        createInstanceBuffers();
+        createDescriptorPool();
+        createDescriptorSets();
+        createCommandBuffers();
+        createSyncObjects();
+
+        // lines the GPU clock up with the profiler's before the first frame
+        if (_gpuTimer.Enabled) {
+            auto commandBuffer = beginSingleTimeCommands();
+            _gpuTimer.recordCalibration(commandBuffer);
+            endSingleTimeCommands(commandBuffer);
+            _gpuTimer.calibrate(_profiler.now());
+        }
+    }, {uploads, descriptorSetLayout});
+
+    WorkerPool pool(std::min(std::max(std::thread::hardware_concurrency(), 1u), 4u));
+    startup.run(pool);
+
+    cout << "startup took " << startup.seconds() * 1000.0 << " ms on " << pool.threadCount() << " threads, * marks the critical path:" << endl;
+    for (const auto& timing : startup.timings()) {
+        cout << (timing.Critical ? "  * " : "    ") << std::left << std::setw(24) << timing.Name << std::right << std::fixed << std::setprecision(1)
+             << std::setw(8) << timing.Start * 1000.0 << " +" << std::setw(7) << timing.Seconds * 1000.0 << " ms  thread " << timing.Thread << endl;
+    }
+    cout.unsetf(std::ios::fixed);
+    cout << std::setprecision(6);
 }
 
 void App::mainLoop() {
-    while (!_appWindow.windowClosing()) {
-        drawFrame();
+    _profiler.nameThread("render");
+    if (!InstanceBenchmark.empty()) {
+        benchmarkInstances();
+    } else if (BenchFrames > 0) {
+        benchmarkScenario();
+    } else {
+        while (!shouldClose()) {
+            drawFrame();
+        }
     }
 
     vkDeviceWaitIdle(_device);
+    flushReadbacks();
+    _imageWriter->finish();
+
+    if (_culling.Enabled && _cullFrames > 0) {
+        cout << "GPU culling: " << _cullTotals.Visible / _cullFrames << " of " << _cullTotals.Objects / _cullFrames << " objects visible per frame, "
+             << _cullTotals.FrustumCulled / _cullFrames << " frustum culled, " << _cullTotals.OcclusionCulled / _cullFrames << " occluded" << endl;
+    }
+
+    auto uploadStats = _uploader.getStats();
+    cout << "uploads: " << uploadStats.Uploads << " (" << uploadStats.Bytes / 1024 << " KiB) in " << uploadStats.Batches << " batches on the "
+         << (_uploader.dedicatedTransfer() ? "transfer" : "graphics") << " queue, " << uploadStats.WaitSeconds * 1000.0 << " ms waiting" << endl;
+
+    auto memoryStats = _allocator.getStats();
+    cout << "device memory: " << memoryStats.BytesUsed << " of " << memoryStats.BytesReserved << " bytes used in " << memoryStats.BlockCount << " blocks, "
+         << memoryStats.AllocationCount << " allocations, fragmentation " << memoryStats.Fragmentation << endl;
+
+    if (_yuvCheckFrames > 0) {
+        // float rounding on either side can land one step apart
+        cout << "yuv check: " << _yuvCheckFrames << " frames against the CPU reference, largest difference Y " << _yuvCheckMaxDifference[0]
+             << " U " << _yuvCheckMaxDifference[1] << " V " << _yuvCheckMaxDifference[2] << endl;
+    }
+
+    auto stats = _imageWriter->getStats();
+    cout << "image writer: " << stats.Written << " written, queue depth " << stats.QueueDepth << " (max " << stats.MaxQueueDepth << "), "
+         << stats.Stalls << " stalls (" << stats.StallSeconds << "s), " << stats.Dropped << " dropped, " << stats.Skipped << " skipped" << endl;
+    if (stats.Stream.Bytes > 0) {
+        // sustained over the whole capture, and while actually inside the writes
+        double megabytes = stats.Stream.Bytes / 1e6;
+        if (_yuvConverter.Enabled && !YuvCheck) {
+            auto rgbaSize = static_cast<double>(_swapchainExtent.width) * _swapchainExtent.height * 4;
+            cout << "readback: " << _readbackSize / 1024 << " KiB of YUV per frame, " << rgbaSize / _readbackSize << "x less than RGBA" << endl;
+        }
+        cout << "capture: " << stats.Stream.Frames << " frames, " << megabytes << " MB to " << CaptureTarget << ", "
+             << megabytes / std::max(stats.Stream.Seconds, 1e-9) << " MB/s sustained, " << megabytes / std::max(stats.Stream.WriteSeconds, 1e-9) << " MB/s writing" << endl;
+    }
+
+    if (_profiler.Enabled) {
+        _profiler.writeChromeTrace(ProfilePath + ".json");
+        _profiler.writeCsv(ProfilePath + ".csv");
+        cout << "profile: " << _profiler.eventCount() << " events over " << _frameNumber << " frames in " << ProfilePath << ".json and " << ProfilePath << ".csv"
+             << (_gpuTimer.Enabled ? "" : ", CPU only") << endl;
+    }
 }
 
 void App::cleanup() {
     cleanupSwapchain();
+    _recorder.cleanup();
+    _culling.cleanup();
+    _yuvConverter.cleanup();
+    _gpuTimer.cleanup();
+    _uploader.cleanup();
 
     vkDestroySampler(_device, _textureSampler, nullptr);
     vkDestroyImageView(_device, _textureImageView, nullptr);
     vkDestroyImage(_device, _textureImage, nullptr);
-    vkFreeMemory(_device, _textureImageMemory, nullptr);
+    _allocator.free(_textureImageMemory);
 
+    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
     vkDestroyDescriptorSetLayout(_device, _descriptorSetLayout, nullptr);
 
+    vkDestroyBuffer(_device, _uniformBuffer, nullptr);
+    _allocator.free(_uniformBufferMemory);
+    vkDestroyBuffer(_device, _instanceBuffer, nullptr);
+    _allocator.free(_instanceBufferMemory);
+
     vkDestroyBuffer(_device, _indexBuffer, nullptr);
-    vkFreeMemory(_device, _indexBufferMemory, nullptr);
+    _allocator.free(_indexBufferMemory);
     vkDestroyBuffer(_device, _vertexBuffer, nullptr);
-    vkFreeMemory(_device, _vertexBufferMemory, nullptr);
+    _allocator.free(_vertexBufferMemory);
 
-    for (size_t i = 0; i < _maxFramesInFlight; i++) {
+    for (uint32_t i = 0; i < Settings.FramesInFlight; i++) {
         vkDestroySemaphore(_device, _renderFinishedSemaphores[i], nullptr);
         vkDestroySemaphore(_device, _imageAvailableSemaphores[i], nullptr);
         vkDestroyFence(_device, _inFlightFences[i], nullptr);
     }
     vkDestroyCommandPool(_device, _commandPool, nullptr);
 
+    _pipelineCache.cleanup();
+    _allocator.cleanup();
     _appDevice.cleanup();
-    _appWindow.cleanup();
+    if (!Headless) {
+        _appWindow.cleanup();
+    }
     _appInstance.cleanup();
 }
 
+bool App::shouldClose() {
+    if (Headless) {
+        return _closing;
+    }
+    return _appWindow.windowClosing();
+}
+
 VkSurfaceFormatKHR App::chooseSwapSurfaceFormat(const vector<VkSurfaceFormatKHR>& available) {
     if (available.size() == 1 && available[0].format == VK_FORMAT_UNDEFINED) {
         return {VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
@@ -141,17 +347,22 @@ VkSurfaceFormatKHR App::chooseSwapSurfaceFormat(const vector<VkSurfaceFormatKHR>
 }
 
 VkPresentModeKHR App::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& available) {
-    VkPresentModeKHR bestMode = VK_PRESENT_MODE_FIFO_KHR;
+    VkPresentModeKHR preferred = VK_PRESENT_MODE_FIFO_KHR;
+    switch (Settings.PresentMode) {
+    case PresentModeType::Fifo: preferred = VK_PRESENT_MODE_FIFO_KHR; break;
+    case PresentModeType::Mailbox: preferred = VK_PRESENT_MODE_MAILBOX_KHR; break;
+    case PresentModeType::Immediate: preferred = VK_PRESENT_MODE_IMMEDIATE_KHR; break;
+    }
 
     for (const auto& avail : available) {
-        if (avail == VK_PRESENT_MODE_MAILBOX_KHR) {
+        if (avail == preferred) {
             return avail;
-        } else if (avail == VK_PRESENT_MODE_IMMEDIATE_KHR) {
-            bestMode = avail;
         }
     }
 
-    return bestMode;
+    // FIFO is the one mode every surface has to support
+    cout << "preferred present mode not supported, using FIFO" << endl;
+    return VK_PRESENT_MODE_FIFO_KHR;
 }
 
 
@@ -175,13 +386,18 @@ VkExtent2D App::chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
 }
 
 void App::createSwapchain() {
+    if (Headless) {
+        createOffscreenTargets();
+        return;
+    }
+
     auto swapChainSupport = _appDevice.getSwapChainSupportDetails();
 
     auto surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
     auto presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
     auto extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+    uint32_t imageCount = Settings.SwapchainImages > 0 ? max(Settings.SwapchainImages, swapChainSupport.capabilities.minImageCount) : swapChainSupport.capabilities.minImageCount + 1;
     if (swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount) {
         imageCount = swapChainSupport.capabilities.maxImageCount;
     }
@@ -195,6 +411,13 @@ void App::createSwapchain() {
     createInfo.imageExtent = extent;
     createInfo.imageArrayLayers = 1;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    if (_yuvConverter.Enabled && !(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_SAMPLED_BIT)) {
+        cout << "GPU YUV conversion disabled: swapchain images can't be sampled" << endl;
+        _yuvConverter.Enabled = false;
+    }
+    if (_yuvConverter.Enabled) {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
 
     QueueFamilyIndices indices = _appDevice.DeviceQueueFamilyIndices;
     uint32_t queueFamilyIndices[] = {(uint32_t) indices.graphicsFamily, (uint32_t) indices.presentFamily};
@@ -224,6 +447,28 @@ void App::createSwapchain() {
 
     _swapchainImageFormat = surfaceFormat.format;
     _swapchainExtent = extent;
+    _targetImageLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+void App::createOffscreenTargets() {
+    // one device-local target per frame in flight, used round-robin in place of swapchain images
+    _swapchainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    _swapchainExtent = {Width, Height};
+    _targetImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    if (_yuvConverter.Enabled) {
+        usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+
+    // one target per frame in flight unless asked for more or fewer, reuse waits on the image's fence either way
+    auto targetCount = Settings.SwapchainImages > 0 ? Settings.SwapchainImages : Settings.FramesInFlight;
+    _swapchainImages.resize(targetCount);
+    _offscreenTargetsMemory.resize(targetCount);
+    for (size_t i = 0; i < _swapchainImages.size(); i++) {
+        createImage(_swapchainExtent.width, _swapchainExtent.height, 1, VK_SAMPLE_COUNT_1_BIT, _swapchainImageFormat, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _swapchainImages[i], _offscreenTargetsMemory[i]);
+    }
+    _offscreenTargetIndex = 0;
 }
 
 void App::createImageViews() {
@@ -233,11 +478,11 @@ void App::createImageViews() {
     }
 }
 
-VkImageView App::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels) {
+VkImageView App::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, VkImageViewType viewType) {
     VkImageViewCreateInfo viewInfo = {};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image = image;
-    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.viewType = viewType;
     viewInfo.format = format;
     viewInfo.subresourceRange.aspectMask = aspectFlags;
     viewInfo.subresourceRange.baseMipLevel = 0;
@@ -256,7 +501,7 @@ VkImageView App::createImageView(VkImage image, VkFormat format, VkImageAspectFl
 void App::createDescriptorSetLayout() {
     VkDescriptorSetLayoutBinding uboLayoutBinding = {};
     uboLayoutBinding.binding = 0;
-    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uboLayoutBinding.descriptorCount = 1;
     uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     uboLayoutBinding.pImmutableSamplers = nullptr; // Optional
@@ -268,7 +513,14 @@ void App::createDescriptorSetLayout() {
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {uboLayoutBinding, samplerLayoutBinding};
+    VkDescriptorSetLayoutBinding instanceLayoutBinding = {};
+    instanceLayoutBinding.binding = 2;
+    instanceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    instanceLayoutBinding.descriptorCount = 1;
+    instanceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    instanceLayoutBinding.pImmutableSamplers = nullptr;
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings = {uboLayoutBinding, samplerLayoutBinding, instanceLayoutBinding};
 	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -279,12 +531,21 @@ void App::createDescriptorSetLayout() {
 	}
 }
 
+void App::loadShaders() {
+    _vertShaderCode = Shaders::readFile("shaders/vert.spv");
+    _fragShaderCode = Shaders::readFile("shaders/frag.spv");
+}
+
 void App::createGraphicsPipeline() {
-    auto vertShaderCode = readFile("shaders/vert.spv");
-    auto fragShaderCode = readFile("shaders/frag.spv");
+    auto startTime = std::chrono::high_resolution_clock::now();
 
-    _vertShaderModule = createShaderModule(vertShaderCode);
-    _fragShaderModule = createShaderModule(fragShaderCode);
+    // SPIR-V is read once, swapchain rebuilds only recreate the modules
+    if (_vertShaderCode.empty()) {
+        loadShaders();
+    }
+
+    _vertShaderModule = Shaders::createModule(_device, _vertShaderCode);
+    _fragShaderModule = Shaders::createModule(_device, _fragShaderCode);
 
     VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
     vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -300,8 +561,9 @@ void App::createGraphicsPipeline() {
 
     VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAttributeDescriptions();
+    bool packed = _meshVertexFormat == VertexFormat::Packed;
+    auto bindingDescription = packed ? PackedVertexLayout::bindingDescription() : FullVertexLayout::bindingDescription();
+    auto attributeDescriptions = packed ? PackedVertexLayout::attributeDescriptions() : FullVertexLayout::attributeDescriptions();
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
     vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -406,8 +668,13 @@ void App::createGraphicsPipeline() {
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = 1; // Optional
     pipelineLayoutInfo.pSetLayouts = &_descriptorSetLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-    pipelineLayoutInfo.pPushConstantRanges = 0; // Optional
+    VkPushConstantRange meshDecodeRange = {};
+    meshDecodeRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    meshDecodeRange.offset = 0;
+    meshDecodeRange.size = sizeof(MeshDecode);
+
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &meshDecodeRange;
 
     if (vkCreatePipelineLayout(_device, &pipelineLayoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
         throw std::runtime_error("failed to create pipeline layout!");
@@ -431,25 +698,16 @@ void App::createGraphicsPipeline() {
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
 
-    if (vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS) {
+    if (vkCreateGraphicsPipelines(_device, _pipelineCache.Cache, 1, &pipelineInfo, nullptr, &_graphicsPipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create graphics pipeline");
     }
 
     vkDestroyShaderModule(_device, _fragShaderModule, nullptr);
     vkDestroyShaderModule(_device, _vertShaderModule, nullptr);
-}
 
-VkShaderModule App::createShaderModule(const std::vector<char>& code) {
-    VkShaderModuleCreateInfo createInfo = {};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create shader module!");
-    }
-
-    return shaderModule;
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    float time = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - startTime).count();
+    cout << "graphics pipeline created in " << time << " ms (" << (_pipelineCache.Loaded ? "warm" : "cold") << " pipeline cache)" << endl;
 }
 
 void App::createRenderPass() {
@@ -461,7 +719,8 @@ void App::createRenderPass() {
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    // without MSAA the pass renders straight into the target, which the readback copies from
+    colorAttachment.finalLayout = multisampled() ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
     VkAttachmentReference colorAttachmentRef = {};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -470,11 +729,12 @@ void App::createRenderPass() {
 	depthAttachment.format = findDepthFormat();
     depthAttachment.samples = _appDevice.DeviceMsaaSamples;
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    // the depth pyramid is built from what the pass leaves behind
+	depthAttachment.storeOp = _culling.readsDepth() ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = _culling.readsDepth() ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
     VkAttachmentReference depthAttachmentRef = {};
 	depthAttachmentRef.attachment = 1;
 	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
@@ -487,7 +747,8 @@ void App::createRenderPass() {
     colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // the readback copy at the end of each command buffer reads straight out of the resolve target
+    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
     VkAttachmentReference colorAttachmentResolveRef = {};
     colorAttachmentResolveRef.attachment = 2;
     colorAttachmentResolveRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -497,7 +758,7 @@ void App::createRenderPass() {
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
     subpass.pDepthStencilAttachment = &depthAttachmentRef;
-    subpass.pResolveAttachments = &colorAttachmentResolveRef;
+    subpass.pResolveAttachments = multisampled() ? &colorAttachmentResolveRef : nullptr;
 
     VkSubpassDependency dependency = {};
     dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
@@ -507,15 +768,43 @@ void App::createRenderPass() {
     dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+    VkSubpassDependency readbackDependency = {};
+    readbackDependency.srcSubpass = 0;
+    readbackDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    readbackDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    readbackDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    readbackDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    readbackDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    // the previous frame's pyramid build reads the depth attachment this pass clears
+    VkSubpassDependency depthDependency = {};
+    depthDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    depthDependency.dstSubpass = 0;
+    depthDependency.srcStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    depthDependency.srcAccessMask = 0;
+    depthDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    depthDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+    // and this frame's pyramid build reads what it writes
+    VkSubpassDependency pyramidDependency = {};
+    pyramidDependency.srcSubpass = 0;
+    pyramidDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+    pyramidDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    pyramidDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    pyramidDependency.dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    pyramidDependency.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    std::array<VkSubpassDependency, 4> dependencies = {dependency, readbackDependency, depthDependency, pyramidDependency};
+
     std::array<VkAttachmentDescription, 3> attachments = {colorAttachment, depthAttachment, colorAttachmentResolve};
     VkRenderPassCreateInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.attachmentCount = multisampled() ? 3 : 2;
     renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
+    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    renderPassInfo.pDependencies = dependencies.data();
 
     if (vkCreateRenderPass(_device, &renderPassInfo, nullptr, &_renderPass) != VK_SUCCESS) {
         throw std::runtime_error("failed to create render pass!");
@@ -532,11 +821,14 @@ void App::createFramebuffers() {
 			_depthImageView,
             _swapchainImageViews[i]
 		};
+        if (!multisampled()) {
+            attachments = {_swapchainImageViews[i], _depthImageView, VK_NULL_HANDLE};
+        }
 
         VkFramebufferCreateInfo framebufferInfo = {};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = _renderPass;
-        framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+        framebufferInfo.attachmentCount = multisampled() ? 3 : 2;
         framebufferInfo.pAttachments = attachments.data();
         framebufferInfo.width = _swapchainExtent.width;
         framebufferInfo.height = _swapchainExtent.height;
@@ -556,7 +848,8 @@ void App::createCommandPool() {
     VkCommandPoolCreateInfo poolInfo = {};
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
-    poolInfo.flags = 0; // Optional
+    // only one-shot setup commands come from here, frames are recorded from the recorder's pools
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 
     if (vkCreateCommandPool(_device, &poolInfo, nullptr, &_commandPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create command pool!");
@@ -566,10 +859,22 @@ void App::createCommandPool() {
 void App::createDepthResources() {
     VkFormat depthFormat = findDepthFormat();
 
-    createImage(_swapchainExtent.width, _swapchainExtent.height, 1, _appDevice.DeviceMsaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depthImage, _depthImageMemory);
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if (_culling.readsDepth()) {
+        usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+
+    createImage(_swapchainExtent.width, _swapchainExtent.height, 1, _appDevice.DeviceMsaaSamples, depthFormat, VK_IMAGE_TILING_OPTIMAL, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depthImage, _depthImageMemory);
     _depthImageView = createImageView(_depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 }
 
+void App::createCullingPyramid() {
+    if (!_culling.Enabled)
+        return;
+
+    _culling.createPyramid(_uploader.graphicsCommands(), _depthImageView, _swapchainExtent);
+}
+
 VkFormat App::findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
 	for (VkFormat format : candidates) {
 		VkFormatProperties props;
@@ -596,146 +901,119 @@ bool App::hasStencilComponent(VkFormat format) {
     return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-void App::createTextureImage() {
+void App::loadTexture() {
+    // the compiled KTX2 skips decoding and mipmapping, the JPEG is the fallback for devices without BC
+    if (_appDevice.TextureCompressionBC && loadCompressedTexture()) {
+        return;
+    }
+
+    // a cache built from the same image skips decoding and filtering entirely
+    auto sourceHash = hashFile(_texturePath);
+    auto cachePath = _texturePath + ".mipcache";
+    _textureSourceFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    if (_textureCache.open(cachePath, sourceHash)) {
+        _textureLevels = _textureCache.Levels;
+        return;
+    }
+
     int texWidth, texHeight, texChannels;
     stbi_uc* pixels = stbi_load(_texturePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
-
     if (!pixels) {
         throw std::runtime_error("failed to load texture image!");
     }
 
-    _mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
-
-    VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	void* data;
-	vkMapMemory(_device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(_device, stagingBufferMemory);
-
-	stbi_image_free(pixels);
-
-    createImage(texWidth, texHeight, _mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory);
-
-    transitionImageLayout(_textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _mipLevels);
-    copyBufferToImage(stagingBuffer, _textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-    // image layout is transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL during mipmaps
+    auto startTime = std::chrono::high_resolution_clock::now();
+    _textureMips = MipChain::build(pixels, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+    stbi_image_free(pixels);
+    cout << "texture mip chain built in " << std::chrono::duration<double, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - startTime).count() << " ms" << endl;
 
-    vkDestroyBuffer(_device, stagingBuffer, nullptr);
-    vkFreeMemory(_device, stagingBufferMemory, nullptr);
-
-    generateMipmaps(_textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, _mipLevels);
+    if (!TextureCache::write(cachePath, sourceHash, _textureMips)) {
+        cout << "failed to write texture cache " << cachePath << endl;
+    }
+    for (const auto& level : _textureMips) {
+        _textureLevels.push_back({level.Width, level.Height, level.Data.data(), level.Data.size()});
+    }
 }
 
-void App::generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
+bool App::loadCompressedTexture() {
+    if (!_compressedTexture.open(_compressedTexturePath)) {
+        return false;
+    }
 
     VkFormatProperties formatProperties;
-    vkGetPhysicalDeviceFormatProperties(_physicalDevice, imageFormat, &formatProperties);
-    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-		throw std::runtime_error("texture image format does not support linear blitting!");
-	}
+    vkGetPhysicalDeviceFormatProperties(_physicalDevice, _compressedTexture.Format, &formatProperties);
+    if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+        _compressedTexture.close();
+        return false;
+    }
 
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-    
-    VkImageMemoryBarrier barrier = {};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.image = image;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.subresourceRange.levelCount = 1;
-
-    int32_t mipWidth = texWidth;
-	int32_t mipHeight = texHeight;
-
-	for (uint32_t i = 1; i < mipLevels; i++) {
-		barrier.subresourceRange.baseMipLevel = i - 1;
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-
-		vkCmdPipelineBarrier(commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier);
-
-		VkImageBlit blit = {};
-		blit.srcOffsets[0] = {0, 0, 0};
-		blit.srcOffsets[1] = {mipWidth, mipHeight, 1};
-		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.srcSubresource.mipLevel = i - 1;
-		blit.srcSubresource.baseArrayLayer = 0;
-		blit.srcSubresource.layerCount = 1;
-		blit.dstOffsets[0] = {0, 0, 0};
-		blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
-		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.dstSubresource.mipLevel = i;
-		blit.dstSubresource.baseArrayLayer = 0;
-		blit.dstSubresource.layerCount = 1;
-
-		vkCmdBlitImage(commandBuffer,
-			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &blit,
-			VK_FILTER_LINEAR);
-
-		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-		vkCmdPipelineBarrier(commandBuffer,
-			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-			0, nullptr,
-			0, nullptr,
-			1, &barrier);
-
-		if (mipWidth > 1) mipWidth /= 2;
-		if (mipHeight > 1) mipHeight /= 2;
-	}
+    _textureSourceFormat = _compressedTexture.Format;
+    for (uint32_t i = 0; i < _compressedTexture.Levels.size(); i++) {
+        _textureLevels.push_back({max(_compressedTexture.Width >> i, 1u), max(_compressedTexture.Height >> i, 1u),
+            reinterpret_cast<const uint8_t*>(_compressedTexture.Levels[i].Data), _compressedTexture.Levels[i].Size});
+    }
+    return true;
+}
 
-    barrier.subresourceRange.baseMipLevel = mipLevels - 1;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+void App::createTextureImage() {
+    _textureFormat = _textureSourceFormat;
+    _mipLevels = static_cast<uint32_t>(_textureLevels.size());
+    createImage(_textureLevels[0].Width, _textureLevels[0].Height, _mipLevels, VK_SAMPLE_COUNT_1_BIT, _textureFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _textureImage, _textureImageMemory);
+
+    // every level back to back in the staging ring and copied by one vkCmdCopyBufferToImage;
+    // each level is a whole number of texels or blocks, so the offsets stay aligned
+    std::vector<VkBufferImageCopy> regions(_mipLevels);
+    VkDeviceSize imageSize = 0;
+    for (uint32_t i = 0; i < _mipLevels; i++) {
+        regions[i] = {};
+        regions[i].bufferOffset = imageSize;
+        regions[i].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+        regions[i].imageExtent = {_textureLevels[i].Width, _textureLevels[i].Height, 1};
+        imageSize += _textureLevels[i].Size;
+    }
 
-    vkCmdPipelineBarrier(commandBuffer,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier);
+    auto staged = static_cast<char*>(_uploader.stageImage(_textureImage, imageSize, regions.data(), _mipLevels, _mipLevels, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT));
+    for (uint32_t i = 0; i < _mipLevels; i++) {
+        memcpy(staged + regions[i].bufferOffset, _textureLevels[i].Data, static_cast<size_t>(_textureLevels[i].Size));
+    }
 
-    endSingleTimeCommands(commandBuffer);
-}
+    auto blockSize = Ktx2File::blockSize(_textureFormat);
+    cout << "texture " << (blockSize == 0 ? _texturePath : _compressedTexturePath) << ": " << (blockSize == 0 ? "RGBA8" : blockSize == 8 ? "BC1" : "BC7") << ", "
+         << _mipLevels << " levels, " << imageSize / 1024 << " KiB" << endl;
 
+    // the staging ring holds its own copy now
+    _textureLevels.clear();
+    _textureMips.clear();
+    _textureCache.close();
+    _compressedTexture.close();
+}
 
 void App::createTextureImageView() {
-    _textureImageView = createImageView(_textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, _mipLevels);
+    // an array view so instances can pick a layer, even while the texture only has one
+    _textureImageView = createImageView(_textureImage, _textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, _mipLevels, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
 }
 
 void App::createTextureSampler() {
     VkSamplerCreateInfo samplerInfo = {};
 	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-	samplerInfo.magFilter = VK_FILTER_LINEAR;
-	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.magFilter = Settings.TextureFiltering == None ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+	samplerInfo.minFilter = samplerInfo.magFilter;
 	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-	samplerInfo.anisotropyEnable = VK_TRUE;
-	samplerInfo.maxAnisotropy = 16;
 	samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
 	samplerInfo.unnormalizedCoordinates = VK_FALSE;
 	samplerInfo.compareEnable = VK_FALSE;
 	samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	samplerInfo.mipmapMode = Settings.TextureFiltering <= Bilinear ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	if (Settings.TextureFiltering >= Anisotropic2) {
+		// Anisotropic2 is 2x, each step doubles
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+		samplerInfo.anisotropyEnable = VK_TRUE;
+		samplerInfo.maxAnisotropy = min(static_cast<float>(1u << (Settings.TextureFiltering - Anisotropic1)), properties.limits.maxSamplerAnisotropy);
+	}
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
 	samplerInfo.maxLod = static_cast<float>(_mipLevels);
@@ -746,6 +1024,12 @@ void App::createTextureSampler() {
 }
 
 void App::createColorResources() {
+    // single sampled passes draw into the target itself
+    _colorImage = VK_NULL_HANDLE;
+    _colorImageView = VK_NULL_HANDLE;
+    if (!multisampled())
+        return;
+
     VkFormat colorFormat = _swapchainImageFormat;
     int w = _swapchainExtent.width;
     int h = _swapchainExtent.height;
@@ -753,11 +1037,53 @@ void App::createColorResources() {
     createImage(w, h, 1, _appDevice.DeviceMsaaSamples, colorFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _colorImage, _colorImageMemory);
     _colorImageView = createImageView(_colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 
+}
+
+void App::createReadbackBuffers() {
+    // one persistently mapped slot per target image, written by the copy at the end of its command buffer.
+    // Rows are laid out at the pitch the device copies fastest, PixelConverter reads them back at that pitch
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
+    VkDeviceSize pitchAlignment = std::max<VkDeviceSize>(deviceProperties.limits.optimalBufferCopyRowPitchAlignment, 4);
+    VkDeviceSize offsetAlignment = std::max<VkDeviceSize>(deviceProperties.limits.optimalBufferCopyOffsetAlignment, 16);
+    _readbackRowPitch = (static_cast<VkDeviceSize>(_swapchainExtent.width) * 4 + pitchAlignment - 1) / pitchAlignment * pitchAlignment;
+    // bufferRowLength is in texels, so the pitch has to stay a whole number of them
+    _readbackRowPitch = (_readbackRowPitch + 3) / 4 * 4;
+
+    VkDeviceSize rgbaSize = _readbackRowPitch * _swapchainExtent.height;
+    VkDeviceSize bufferSize = rgbaSize;
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    _readbackRgbaOffset = 0;
+    if (_yuvConverter.Enabled) {
+        // the compute pass writes the planes instead, the check copies the RGBA image behind them
+        bufferSize = Yuv420Layout::padded(_swapchainExtent.width, _swapchainExtent.height).Size;
+        _readbackRgbaOffset = (bufferSize + offsetAlignment - 1) / offsetAlignment * offsetAlignment;
+        if (YuvCheck) {
+            bufferSize = _readbackRgbaOffset + rgbaSize;
+        }
+        usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    }
+    _readbackSize = bufferSize;
     VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-    createImage(w, h, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_LINEAR, VK_IMAGE_USAGE_TRANSFER_DST_BIT, properties, _offscreenImage, _offscreenImageMemory);
+
+    _readbackFrames.assign(_swapchainImages.size(), -1);
+    _slotFrames.assign(_swapchainImages.size(), -1);
+    // the slots stay, empty, so frame bookkeeping doesn't care whether anything is read back
+    size_t buffers = Settings.SaveToFile ? _swapchainImages.size() : 0;
+    _readbackBuffers.resize(buffers);
+    _readbackBuffersMemory.resize(buffers);
+    _readbackMapped.resize(buffers);
+
+    for (size_t i = 0; i < buffers; i++) {
+        // cached memory keeps the CPU-side reads from crawling through write-combined memory
+        createBuffer(bufferSize, usage, properties, _readbackBuffers[i], _readbackBuffersMemory[i], VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        _readbackMapped[i] = _readbackBuffersMemory[i].Mapped;
+    }
+
+    _yuvConverter.createDescriptorSets(_swapchainImageViews, _readbackBuffers, _swapchainExtent);
 }
 
-void App::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+void App::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, AppAllocation& bufferMemory, VkMemoryPropertyFlags preferredProperties, AppAllocationStrategy strategy) {
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
@@ -771,20 +1097,13 @@ void App::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryProp
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(_device, buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(_device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-		throw std::runtime_error("failed to allocate vertex buffer memory!");
-	}
+	bufferMemory = _allocator.allocate(memRequirements, properties, preferredProperties, true, strategy);
 
-    vkBindBufferMemory(_device, buffer, bufferMemory, 0);
+    vkBindBufferMemory(_device, buffer, bufferMemory.Memory, bufferMemory.Offset);
 }
 
 
-void App::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+void App::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, AppAllocation& imageMemory) {
     VkImageCreateInfo imageInfo = {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -807,118 +1126,258 @@ void App::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSam
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(_device, image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+    imageMemory = _allocator.allocate(memRequirements, properties, 0, tiling == VK_IMAGE_TILING_LINEAR, AppAllocationStrategy::Buddy);
 
-    if (vkAllocateMemory(_device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
+    vkBindImageMemory(_device, image, imageMemory.Memory, imageMemory.Offset);
+}
+
+void App::loadModel() {
+    _meshVertexFormat = ModelVertexFormat;
+
+    // a cache built from the same source skips OBJ parsing entirely
+    auto sourceHash = hashFile(_modelPath);
+    auto cachePath = _modelPath + ".meshcache";
+    if (_meshCache.open(cachePath, sourceHash, sizeof(Vertex))) {
+        _meshVertices = static_cast<const Vertex*>(_meshCache.Vertices);
+        _vertexCount = static_cast<size_t>(_meshCache.VertexCount);
+        _meshIndices = _meshCache.Indices;
+        _indexCount = static_cast<size_t>(_meshCache.IndexCount);
+        return;
+    }
+
+    auto stats = ObjLoader::load(_modelPath, _vertices, _indices);
+    cout << "model parsed in " << stats.Seconds * 1000.0 << " ms on " << stats.Threads << " thread(s): "
+         << stats.megabytesPerSecond() << " MB/s, " << stats.trianglesPerSecond() << " tris/s" << endl;
+
+    // optimised before caching, so a cache hit gets the reordered mesh for free
+    auto optimizeStats = MeshOptimizer::optimize(_vertices, _indices);
+    cout << "mesh optimized in " << optimizeStats.Seconds * 1000.0 << " ms, " << optimizeStats.Clusters << " clusters: ACMR "
+         << optimizeStats.Before.Acmr << " -> " << optimizeStats.After.Acmr << ", ATVR "
+         << optimizeStats.Before.Atvr << " -> " << optimizeStats.After.Atvr << endl;
+
+    if (!MeshCache::write(cachePath, sourceHash, sizeof(Vertex), _vertices.data(), _vertices.size(), _indices.data(), _indices.size())) {
+        cout << "failed to write mesh cache " << cachePath << endl;
     }
 
-    vkBindImageMemory(_device, image, imageMemory, 0);
+    _meshVertices = _vertices.data();
+    _vertexCount = _vertices.size();
+    _meshIndices = _indices.data();
+    _indexCount = _indices.size();
 }
 
-void App::loadModel() {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
+void App::createVertexBuffer() {
+    bool packed = _meshVertexFormat == VertexFormat::Packed;
+    VkDeviceSize vertexSize = packed ? sizeof(PackedVertex) : sizeof(Vertex);
+    VkDeviceSize bufferSize = vertexSize * _vertexCount;
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, _modelPath.c_str())) {
-        throw std::runtime_error(warn + err);
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertexBuffer, _vertexBufferMemory);
+    void* staged = _uploader.stageBuffer(_vertexBuffer, bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
+
+    // quantized straight into the staging ring
+    if (packed) {
+        _meshDecode = packVertices(_meshVertices, _vertexCount, static_cast<PackedVertex*>(staged));
+    } else {
+        memcpy(staged, _meshVertices, (size_t) bufferSize);
+        _meshDecode = MeshDecode::identity();
     }
+    cout << "vertex buffer " << bufferSize / 1024 << " KiB, " << vertexSize << " bytes per vertex" << endl;
+}
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
+void App::createIndexBuffer() {
+    // 16 bit indices halve the index fetch bandwidth whenever every vertex fits
+    _indexType = _vertexCount <= std::numeric_limits<uint16_t>::max() ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+    VkDeviceSize indexSize = _indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    VkDeviceSize bufferSize = indexSize * _indexCount;
 
-    for (const auto& shape : shapes) {
-	    for (const auto& index : shape.mesh.indices) {
-			Vertex vertex = {};
-            vertex.pos = {
-				attrib.vertices[3 * index.vertex_index + 0],
-				attrib.vertices[3 * index.vertex_index + 1],
-				attrib.vertices[3 * index.vertex_index + 2]
-			};
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _indexBuffer, _indexBufferMemory);
+    void* staged = _uploader.stageBuffer(_indexBuffer, bufferSize, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
 
-			vertex.texCoord = {
-				attrib.texcoords[2 * index.texcoord_index + 0],
-				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-			};
+    if (_indexType == VK_INDEX_TYPE_UINT16) {
+        auto indices = static_cast<uint16_t*>(staged);
+        for (size_t i = 0; i < _indexCount; i++) {
+            indices[i] = static_cast<uint16_t>(_meshIndices[i]);
+        }
+    } else {
+        memcpy(staged, _meshIndices, (size_t) bufferSize);
+    }
+}
 
-            vertex.color = {1.0f, 1.0f, 1.0f};
+void App::createUniformBuffers() {
+    // every slot is bound through a dynamic offset, so it has to honour the device's offset alignment
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+    auto alignment = properties.limits.minUniformBufferOffsetAlignment;
+    _uniformStride = (sizeof(UniformBufferObject) + alignment - 1) / alignment * alignment;
 
-            if (uniqueVertices.count(vertex) == 0) {
-				uniqueVertices[vertex] = static_cast<uint32_t>(_vertices.size());
-				_vertices.push_back(vertex);
-			}
+    // one region per target image, each holding _maxUniformObjects slots
+    _uniformRingFrames = static_cast<uint32_t>(_swapchainImages.size());
+    VkDeviceSize bufferSize = _uniformStride * _maxUniformObjects * _uniformRingFrames;
 
-			_indices.push_back(uniqueVertices[vertex]);
-		}
-	}
+    createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _uniformBuffer, _uniformBufferMemory);
 }
 
-void App::createVertexBuffer() {
-    VkDeviceSize bufferSize = sizeof(_vertices[0]) * _vertices.size();
+uint32_t App::uniformOffset(uint32_t frame, uint32_t object) {
+    return static_cast<uint32_t>((frame * _maxUniformObjects + object) * _uniformStride);
+}
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+void App::createInstanceBuffers() {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(_physicalDevice, &properties);
+    auto alignment = properties.limits.minStorageBufferOffsetAlignment;
 
-    void* data;
-    vkMapMemory(_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, _vertices.data(), (size_t) bufferSize);
-    vkUnmapMemory(_device, stagingBufferMemory);
+    // one region per target image, like the uniform ring
+    _instanceCapacity = std::max(InstanceCount, 1u);
+    _instanceRegionSize = (sizeof(InstanceData) * _instanceCapacity + alignment - 1) / alignment * alignment;
+    _instanceRingFrames = static_cast<uint32_t>(_swapchainImages.size());
+    VkDeviceSize bufferSize = _instanceRegionSize * _instanceRingFrames;
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertexBuffer, _vertexBufferMemory);
-    copyBuffer(stagingBuffer, _vertexBuffer, bufferSize);
+    createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _instanceBuffer, _instanceBufferMemory);
+    // one indirect command per instance, sized and ringed the same way
+    _culling.createBuffers(_instanceCapacity, _instanceRingFrames);
+}
 
-    vkDestroyBuffer(_device, stagingBuffer, nullptr);
-    vkFreeMemory(_device, stagingBufferMemory, nullptr);
+uint32_t App::instanceOffset(uint32_t frame) {
+    return static_cast<uint32_t>(frame * _instanceRegionSize);
 }
 
-void App::createIndexBuffer() {
-    VkDeviceSize bufferSize = sizeof(_indices[0]) * _indices.size();
+void App::setInstanceCount(uint32_t count) {
+    vkDeviceWaitIdle(_device);
+    flushReadbacks();
+
+    // commands are recorded every frame, only the buffers have to grow
+    InstanceCount = count;
+    if (InstanceCount > _instanceCapacity) {
+        vkDestroyBuffer(_device, _instanceBuffer, nullptr);
+        _allocator.free(_instanceBufferMemory);
+        _culling.cleanupBuffers();
+        createInstanceBuffers();
+        writeDescriptorSet();
+    }
+}
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+void App::benchmarkInstances() {
+    const uint32_t warmupFrames = 30;
+    const uint32_t measuredFrames = 300;
 
-    void* data;
-    vkMapMemory(_device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, _indices.data(), (size_t) bufferSize);
-    vkUnmapMemory(_device, stagingBufferMemory);
+    cout << "instances, ms/frame, fps, instance update ms/frame, record ms/frame (" << _recorder.threadCount() << " threads), fence wait ms/frame, visible/frame, frustum culled/frame, occluded/frame, limit" << endl;
+    for (auto count : InstanceBenchmark) {
+        setInstanceCount(count);
+        for (uint32_t frame = 0; frame < warmupFrames && !shouldClose(); frame++) {
+            drawFrame();
+        }
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _indexBuffer, _indexBufferMemory);
-    copyBuffer(stagingBuffer, _indexBuffer, bufferSize);
+        _instanceUpdateSeconds = 0.0;
+        _fenceWaitSeconds = 0.0;
+        _recordSeconds = 0.0;
+        _cullTotals = {};
+        _cullFrames = 0;
+        auto startTime = std::chrono::high_resolution_clock::now();
 
-    vkDestroyBuffer(_device, stagingBuffer, nullptr);
-    vkFreeMemory(_device, stagingBufferMemory, nullptr);
+        uint32_t frames = 0;
+        for (; frames < measuredFrames && !shouldClose(); frames++) {
+            drawFrame();
+        }
+        vkDeviceWaitIdle(_device);
+
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double, std::chrono::seconds::period>(currentTime - startTime).count();
+        if (frames == 0)
+            break;
+
+        // a CPU that mostly waits on fences is feeding a GPU that cannot keep up
+        double frameMs = seconds * 1000.0 / frames;
+        double fenceMs = _fenceWaitSeconds * 1000.0 / frames;
+        // without GPU culling every instance is drawn
+        double cullFrames = std::max(_cullFrames, 1u);
+        double visible = _culling.Enabled ? _cullTotals.Visible / cullFrames : count;
+        cout << count << ", " << frameMs << ", " << frames / seconds << ", " << _instanceUpdateSeconds * 1000.0 / frames << ", "
+             << _recordSeconds * 1000.0 / frames << ", " << fenceMs << ", " << visible << ", " << _cullTotals.FrustumCulled / cullFrames << ", " << _cullTotals.OcclusionCulled / cullFrames << ", "
+             << (fenceMs > frameMs * 0.5 ? "GPU" : "CPU") << endl;
+    }
 }
 
-void App::createUniformBuffers() {
-    VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+void App::benchmarkScenario() {
+    const uint32_t warmupFrames = 30;
 
-    _uniformBuffers.resize(_swapchainImages.size());
-    _uniformBuffersMemory.resize(_swapchainImages.size());
+    for (uint32_t frame = 0; frame < warmupFrames && !shouldClose(); frame++) {
+        drawFrame();
+    }
+    _cullTotals = {};
+    _cullFrames = 0;
+    auto streamBytes = _imageWriter->getStats().Stream.Bytes;
+
+    // interval between consecutive frames, so fence and writer stalls count against the frame that hit them
+    std::vector<double> frameMs;
+    frameMs.reserve(BenchFrames);
+    auto startTime = std::chrono::high_resolution_clock::now();
+    auto lastTime = startTime;
+    for (uint32_t frame = 0; frame < BenchFrames && !shouldClose(); frame++) {
+        drawFrame();
+        auto currentTime = std::chrono::high_resolution_clock::now();
+        frameMs.push_back(std::chrono::duration<double, std::chrono::milliseconds::period>(currentTime - lastTime).count());
+        lastTime = currentTime;
+    }
+    if (frameMs.empty())
+        return;
+    double seconds = std::chrono::duration<double, std::chrono::seconds::period>(lastTime - startTime).count();
 
-    for (size_t i = 0; i < _swapchainImages.size(); i++) {
-        createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _uniformBuffers[i], _uniformBuffersMemory[i]);
+    // the capture rate counts until the last measured frame is in the stream
+    vkDeviceWaitIdle(_device);
+    flushReadbacks();
+    _imageWriter->finish();
+    double captureSeconds = std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+    double captureMegabytes = (_imageWriter->getStats().Stream.Bytes - streamBytes) / 1e6;
+
+    double totalMs = 0.0;
+    for (double ms : frameMs) {
+        totalMs += ms;
+    }
+    std::vector<double> sorted = frameMs;
+    std::sort(sorted.begin(), sorted.end());
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(_physicalDevice, &deviceProperties);
+    auto memoryStats = _allocator.getStats();
+    double visible = _culling.Enabled && _cullFrames > 0 ? static_cast<double>(_cullTotals.Visible) / _cullFrames : InstanceCount;
+
+    // one JSON object per line, so runs can be appended to the same file and diffed or plotted
+    std::ostringstream json;
+    json << "{\"scenario\":\"" << jsonEscape(BenchName) << "\",\"device\":\"" << jsonEscape(deviceProperties.deviceName) << "\""
+         << ",\"width\":" << _swapchainExtent.width << ",\"height\":" << _swapchainExtent.height
+         << ",\"msaa\":" << static_cast<uint32_t>(_appDevice.DeviceMsaaSamples) << ",\"frames_in_flight\":" << Settings.FramesInFlight
+         << ",\"instances\":" << InstanceCount << ",\"triangles\":" << static_cast<uint64_t>(InstanceCount) * (_indexCount / 3)
+         << ",\"visible_instances\":" << visible << ",\"capture\":" << (Settings.SaveToFile ? "true" : "false")
+         << ",\"frames\":" << frameMs.size()
+         << ",\"avg_ms\":" << totalMs / frameMs.size() << ",\"p50_ms\":" << percentile(sorted, 0.50)
+         << ",\"p95_ms\":" << percentile(sorted, 0.95) << ",\"p99_ms\":" << percentile(sorted, 0.99) << ",\"max_ms\":" << sorted.back()
+         << ",\"fps\":" << frameMs.size() / seconds << ",\"capture_mb_s\":" << captureMegabytes / captureSeconds
+         << ",\"peak_rss_mb\":" << peakResidentBytes() / 1e6 << ",\"device_memory_mb\":" << memoryStats.BytesReserved / 1e6 << "}";
+
+    cout << json.str() << endl;
+    if (!BenchOutput.empty()) {
+        std::ofstream file(BenchOutput, std::ios::app);
+        if (!file.is_open()) {
+            throw std::runtime_error("failed to open benchmark output!");
+        }
+        file << json.str() << "\n";
     }
 }
 
 void App::createDescriptorPool() {
 
-    std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(_swapchainImages.size());
+    std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = 1;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(_swapchainImages.size());
+	poolSizes[1].descriptorCount = 1;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSizes[2].descriptorCount = 1;
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(_swapchainImages.size());
+	poolInfo.maxSets = 1;
 
     if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
         throw std::runtime_error("failed to create descriptor pool!");
@@ -926,202 +1385,222 @@ void App::createDescriptorPool() {
 }
 
 void App::createDescriptorSets() {
-	std::vector<VkDescriptorSetLayout> layouts(_swapchainImages.size(), _descriptorSetLayout);
-
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = _descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(_swapchainImages.size());
-	allocInfo.pSetLayouts = layouts.data();
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &_descriptorSetLayout;
 
-	_descriptorSets.resize(_swapchainImages.size());
-	if (vkAllocateDescriptorSets(_device, &allocInfo, _descriptorSets.data()) != VK_SUCCESS) {
+	if (vkAllocateDescriptorSets(_device, &allocInfo, &_descriptorSet) != VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate descriptor sets!");
 	}
 
-	for (size_t i = 0; i < _swapchainImages.size(); i++) {
-	    VkDescriptorBufferInfo bufferInfo = {};
-		bufferInfo.buffer = _uniformBuffers[i];
-		bufferInfo.offset = 0;
-		bufferInfo.range = sizeof(UniformBufferObject);
-
-        VkDescriptorImageInfo imageInfo = {};
-		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageInfo.imageView = _textureImageView;
-		imageInfo.sampler = _textureSampler;
-
-        std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
-
-		descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[0].dstSet = _descriptorSets[i];
-		descriptorWrites[0].dstBinding = 0;
-		descriptorWrites[0].dstArrayElement = 0;
-		descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		descriptorWrites[0].descriptorCount = 1;
-		descriptorWrites[0].pBufferInfo = &bufferInfo;
-
-		descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrites[1].dstSet = _descriptorSets[i];
-		descriptorWrites[1].dstBinding = 1;
-		descriptorWrites[1].dstArrayElement = 0;
-		descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		descriptorWrites[1].descriptorCount = 1;
-		descriptorWrites[1].pImageInfo = &imageInfo;
-
-		vkUpdateDescriptorSets(_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
-	}
+    writeDescriptorSet();
 }
 
-void App::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-    VkBufferCopy copyRegion = {};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-    endSingleTimeCommands(commandBuffer);
+void App::writeDescriptorSet() {
+    // the range covers a single object, the dynamic offset picks the frame and object
+    VkDescriptorBufferInfo bufferInfo = {};
+	bufferInfo.buffer = _uniformBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = sizeof(UniformBufferObject);
+
+    VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = _textureImageView;
+	imageInfo.sampler = _textureSampler;
+
+    VkDescriptorBufferInfo instanceInfo = {};
+    instanceInfo.buffer = _instanceBuffer;
+    instanceInfo.offset = 0;
+    instanceInfo.range = sizeof(InstanceData) * _instanceCapacity;
+
+    std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+
+	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[0].dstSet = _descriptorSet;
+	descriptorWrites[0].dstBinding = 0;
+	descriptorWrites[0].dstArrayElement = 0;
+	descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptorWrites[0].descriptorCount = 1;
+	descriptorWrites[0].pBufferInfo = &bufferInfo;
+
+	descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[1].dstSet = _descriptorSet;
+	descriptorWrites[1].dstBinding = 1;
+	descriptorWrites[1].dstArrayElement = 0;
+	descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[1].descriptorCount = 1;
+	descriptorWrites[1].pImageInfo = &imageInfo;
+
+    descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[2].dstSet = _descriptorSet;
+    descriptorWrites[2].dstBinding = 2;
+    descriptorWrites[2].dstArrayElement = 0;
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    descriptorWrites[2].descriptorCount = 1;
+    descriptorWrites[2].pBufferInfo = &instanceInfo;
+
+	vkUpdateDescriptorSets(_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+    _culling.writeDescriptorSets(_uniformBuffer, sizeof(UniformBufferObject), _instanceBuffer, sizeof(InstanceData) * _instanceCapacity);
 }
 
-uint32_t App::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &memProperties);
-
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-			return i;
-		}
-	}
-	throw std::runtime_error("failed to find suitable memory type!");
+void App::createCommandBuffers() {
+    _recorder.createFrames(static_cast<uint32_t>(_swapchainFramebuffers.size()));
+    _gpuTimer.createQueries(static_cast<uint32_t>(_swapchainFramebuffers.size()));
 }
 
-void App::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+VkCommandBuffer App::recordCommandBuffer(uint32_t imageIndex) {
+    auto startTime = std::chrono::high_resolution_clock::now();
 
-    VkImageMemoryBarrier barrier = {};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-	barrier.oldLayout = oldLayout;
-	barrier.newLayout = newLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
-	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = mipLevels;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
+    // the fence of the image's last submission has signalled, so its pools can be reset
+    auto commandBuffer = _recorder.beginPrimary(imageIndex);
+    _gpuTimer.begin(commandBuffer, imageIndex);
 
-    VkPipelineStageFlags sourceStage;
-	VkPipelineStageFlags destinationStage;
-
-    if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    if (_culling.Enabled) {
+        _culling.recordCull(commandBuffer, imageIndex, uniformOffset(imageIndex, 0), instanceOffset(imageIndex), InstanceCount);
+    }
 
-		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-	} else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    // the draw list is split into one contiguous range of instances per thread
+    auto threads = _recorder.threadCount();
+    bool split = !_culling.Enabled || _culling.splitsDraws(InstanceCount);
+    _recorder.recordSecondaries(imageIndex, _renderPass, _swapchainFramebuffers[imageIndex], [&](VkCommandBuffer secondary, unsigned thread) {
+        uint32_t first = split ? static_cast<uint32_t>(uint64_t(InstanceCount) * thread / threads) : 0;
+        uint32_t last = split ? static_cast<uint32_t>(uint64_t(InstanceCount) * (thread + 1) / threads) : (thread == 0 ? InstanceCount : 0);
+        if (first < last) {
+            recordDraws(secondary, imageIndex, first, last - first);
+        }
+    });
+
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = _renderPass;
+    renderPassInfo.framebuffer = _swapchainFramebuffers[imageIndex];
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = _swapchainExtent;
+    std::array<VkClearValue, 2> clearValues = {};
+    clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
+    clearValues[1].depthStencil = {1.0f, 0};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    _gpuTimer.write(commandBuffer, imageIndex, GpuRenderPassBegin);
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    _recorder.executeSecondaries(commandBuffer, imageIndex);
+    vkCmdEndRenderPass(commandBuffer);
+    _gpuTimer.write(commandBuffer, imageIndex, GpuRenderPassEnd);
+
+    if (_culling.Enabled) {
+        _culling.recordStats(commandBuffer, imageIndex);
+        // read by the next frame's cull pass
+        _culling.recordPyramid(commandBuffer);
+    }
 
-		sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-	} else {
-		throw std::invalid_argument("unsupported layout transition!");
-	}
+    _gpuTimer.write(commandBuffer, imageIndex, GpuReadbackBegin);
+    recordReadback(commandBuffer, imageIndex);
+    _gpuTimer.write(commandBuffer, imageIndex, GpuReadbackEnd);
 
-	vkCmdPipelineBarrier(
-		commandBuffer,
-        sourceStage, destinationStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
 
-    endSingleTimeCommands(commandBuffer);
+    _recordSeconds += std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+    return commandBuffer;
 }
 
-void App::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-
-	region.imageOffset = {0, 0, 0};
-	region.imageExtent = {width, height, 1};
-
-    vkCmdCopyBufferToImage(
-        commandBuffer,
-		buffer,
-		image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&region
-	);
-    endSingleTimeCommands(commandBuffer);
+void App::recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t firstInstance, uint32_t instanceCount) {
+    // secondaries inherit nothing but the render pass, so each one binds everything itself
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
+    vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshDecode), &_meshDecode);
+    VkBuffer vertexBuffers[] = {_vertexBuffer};
+    VkDeviceSize offsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, _indexBuffer, 0, _indexType);
+    // each image's commands read their own region of the uniform and instance rings
+    uint32_t dynamicOffsets[] = {uniformOffset(imageIndex, 0), instanceOffset(imageIndex)};
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSet, 2, dynamicOffsets);
+    if (_culling.Enabled) {
+        _culling.recordDraw(commandBuffer, imageIndex, InstanceCount, firstInstance, instanceCount);
+    } else {
+        vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(_indexCount), instanceCount, 0, 0, firstInstance);
+    }
 }
 
-void App::createCommandBuffers() {
-    _commandBuffers.resize(_swapchainFramebuffers.size());
+void App::recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    VkImage srcImg = _swapchainImages[imageIndex];
+
+    if (!Settings.SaveToFile) {
+        // nothing to copy, the target only has to end up where presenting expects it
+        if (_targetImageLayout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+            transitionImageLayout(commandBuffer, srcImg, _swapchainImageFormat,
+                0, 0,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _targetImageLayout,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        }
+        return;
+    }
 
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.commandPool = _commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = (uint32_t) _commandBuffers.size();
+    VkBufferImageCopy region = {};
+    region.bufferOffset = _readbackRgbaOffset;
+    region.bufferRowLength = static_cast<uint32_t>(_readbackRowPitch / 4);
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {_swapchainExtent.width, _swapchainExtent.height, 1};
+
+    // the render pass leaves the target in transfer source layout
+    if (!_yuvConverter.Enabled || YuvCheck) {
+        vkCmdCopyImageToBuffer(commandBuffer, srcImg, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _readbackBuffers[imageIndex], 1, &region);
+    }
 
-    if (vkAllocateCommandBuffers(_device, &allocInfo, _commandBuffers.data()) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate command buffers!");
+    VkImageLayout layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    VkPipelineStageFlags stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    if (_yuvConverter.Enabled) {
+        transitionImageLayout(commandBuffer, srcImg, _swapchainImageFormat,
+            VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_IMAGE_ASPECT_COLOR_BIT, 1);
+        _yuvConverter.record(commandBuffer, imageIndex);
+        layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
     }
 
-    for (size_t i = 0; i < _commandBuffers.size(); i++) {
-        VkCommandBufferBeginInfo beginInfo = {};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-        beginInfo.pInheritanceInfo = nullptr; // Optional
+    // make the copy visible to the host once the frame's fence signals
+    VkBufferMemoryBarrier bufferBarrier = {};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = _readbackBuffers[imageIndex];
+    bufferBarrier.offset = 0;
+    bufferBarrier.size = VK_WHOLE_SIZE;
 
-        vkBeginCommandBuffer(_commandBuffers[i], &beginInfo);
-    
-        VkRenderPassBeginInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = _renderPass;
-        renderPassInfo.framebuffer = _swapchainFramebuffers[i];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = _swapchainExtent;
-        VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
-        std::array<VkClearValue, 2> clearValues = {};
-        clearValues[0].color = {0.0f, 0.0f, 0.0f, 1.0f};
-        clearValues[1].depthStencil = {1.0f, 0};
-        renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-        renderPassInfo.pClearValues = clearValues.data();
-
-        vkCmdBeginRenderPass(_commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _graphicsPipeline);
-        VkBuffer vertexBuffers[] = {_vertexBuffer};
-		VkDeviceSize offsets[] = {0};
-		vkCmdBindVertexBuffers(_commandBuffers[i], 0, 1, vertexBuffers, offsets);
-        vkCmdBindIndexBuffer(_commandBuffers[i], _indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdBindDescriptorSets(_commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelineLayout, 0, 1, &_descriptorSets[i], 0, nullptr);
-        vkCmdDrawIndexed(_commandBuffers[i], static_cast<uint32_t>(_indices.size()), 1, 0, 0, 0);
-        vkCmdEndRenderPass(_commandBuffers[i]);
-
-        if (vkEndCommandBuffer(_commandBuffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffer!");
-        }
+    vkCmdPipelineBarrier(commandBuffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT | stage, VK_PIPELINE_STAGE_HOST_BIT, 0,
+        0, nullptr,
+        1, &bufferBarrier,
+        0, nullptr);
+
+    if (_targetImageLayout != layout) {
+        transitionImageLayout(commandBuffer, srcImg, _swapchainImageFormat,
+            layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT, 0,
+            layout, _targetImageLayout,
+            stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            VK_IMAGE_ASPECT_COLOR_BIT, 1);
     }
 }
 
 void App::createSyncObjects() {
-    _imageAvailableSemaphores.resize(_maxFramesInFlight);
-    _renderFinishedSemaphores.resize(_maxFramesInFlight);
-    _inFlightFences.resize(_maxFramesInFlight);
+    _imageAvailableSemaphores.resize(Settings.FramesInFlight);
+    _renderFinishedSemaphores.resize(Settings.FramesInFlight);
+    _inFlightFences.resize(Settings.FramesInFlight);
     _imagesInFlight.resize(_swapchainImages.size(), VK_NULL_HANDLE);
 
     VkSemaphoreCreateInfo semaphoreInfo = {};
@@ -1131,7 +1610,7 @@ void App::createSyncObjects() {
     fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO; 
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    for (size_t i = 0; i < _maxFramesInFlight; i++) {
+    for (uint32_t i = 0; i < Settings.FramesInFlight; i++) {
         if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_imageAvailableSemaphores[i]) != VK_SUCCESS ||
             vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_renderFinishedSemaphores[i]) != VK_SUCCESS ||
             vkCreateFence(_device, &fenceInfo, nullptr, &_inFlightFences[i]) != VK_SUCCESS) {
@@ -1141,10 +1620,26 @@ void App::createSyncObjects() {
 }
 
 void App::drawFrame() {
-    vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX);
+    auto frame = _frameNumber;
+    ProfileScope frameScope(&_profiler, "draw_frame", frame);
+
+    auto waitStart = std::chrono::high_resolution_clock::now();
+    {
+        ProfileScope scope(&_profiler, "fence_wait", frame);
+        vkWaitForFences(_device, 1, &_inFlightFences[_currentFrame], VK_TRUE, UINT64_MAX);
+    }
+    _fenceWaitSeconds += std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - waitStart).count();
 
     uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(_device, _swapchain, std::numeric_limits<uint64_t>::max(), _imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &imageIndex);
+    VkResult result = VK_SUCCESS;
+    if (Headless) {
+        // nothing to acquire, the targets are reused round-robin
+        imageIndex = _offscreenTargetIndex;
+        _offscreenTargetIndex = (_offscreenTargetIndex + 1) % static_cast<uint32_t>(_swapchainImages.size());
+    } else {
+        ProfileScope scope(&_profiler, "acquire", frame);
+        result = vkAcquireNextImageKHR(_device, _swapchain, std::numeric_limits<uint64_t>::max(), _imageAvailableSemaphores[_currentFrame], VK_NULL_HANDLE, &imageIndex);
+    }
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		recreateSwapchain();
@@ -1152,34 +1647,88 @@ void App::drawFrame() {
 	} else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
 		throw std::runtime_error("failed to acquire swap chain image!");
 	}
+    // only frames that actually get drawn advance the clock
+    _frameNumber++;
+    _animationSeconds = _clock.seconds(static_cast<uint64_t>(frame));
 
     if (_imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
+        waitStart = std::chrono::high_resolution_clock::now();
+        ProfileScope scope(&_profiler, "fence_wait", frame);
 		vkWaitForFences(_device, 1, &_imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
-        saveFrame(imageIndex);
+        _fenceWaitSeconds += std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - waitStart).count();
 	}
 
+    // the last submission that used this image is done, so its readback slot and timestamps can be consumed
+    resolveGpuTimes(imageIndex);
+    {
+        ProfileScope scope(&_profiler, "save_frame", frame);
+        saveFrame(imageIndex);
+    }
+    auto cullStats = _culling.getStats(imageIndex);
+    if (cullStats.Objects > 0) {
+        _cullTotals.Visible += cullStats.Visible;
+        _cullTotals.FrustumCulled += cullStats.FrustumCulled;
+        _cullTotals.OcclusionCulled += cullStats.OcclusionCulled;
+        _cullTotals.Objects += cullStats.Objects;
+        _cullFrames++;
+    }
+    // instance benchmark frames are not captured, and do not count towards the capture limit
+    _readbackFrames[imageIndex] = Settings.SaveToFile && InstanceBenchmark.empty() ? _currentImage + static_cast<int64_t>(StartFrame) : -1;
+    if (InstanceBenchmark.empty())
+        _currentImage++;
+    _slotFrames[imageIndex] = frame;
+
 	_imagesInFlight[imageIndex] = _inFlightFences[_currentFrame];
 
     VkSemaphore waitSemaphores[] = {_imageAvailableSemaphores[_currentFrame]};
     VkSemaphore signalSemaphores[] = {_renderFinishedSemaphores[_currentFrame]};
     VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
 
-    updateUniformBuffer(imageIndex);
+    {
+        ProfileScope scope(&_profiler, "update_uniforms", frame);
+        updateUniformBuffer(imageIndex);
+    }
+    {
+        ProfileScope scope(&_profiler, "update_instances", frame);
+        updateInstances(imageIndex);
+    }
+    VkCommandBuffer commandBuffer;
+    {
+        ProfileScope scope(&_profiler, "record", frame);
+        commandBuffer = recordCommandBuffer(imageIndex);
+    }
 
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.waitSemaphoreCount = Headless ? 0 : 1;
     submitInfo.pWaitSemaphores = waitSemaphores;
     submitInfo.pWaitDstStageMask = waitStages;
     submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &_commandBuffers[imageIndex];
-    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    submitInfo.signalSemaphoreCount = Headless ? 0 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
     vkResetFences(_device, 1, &_inFlightFences[_currentFrame]);
 
-    if (vkQueueSubmit(_graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFrame]) != VK_SUCCESS) {
-        throw std::runtime_error("failed to submit draw command buffer!");
+    {
+        ProfileScope scope(&_profiler, "submit", frame);
+        if (vkQueueSubmit(_graphicsQueue, 1, &submitInfo, _inFlightFences[_currentFrame]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit draw command buffer!");
+        }
+    }
+
+    // stop once done, the frames still in flight are flushed after the loop
+    bool captureDone = Settings.SaveToFile && Settings.CaptureLimit > 0 && _currentImage >= static_cast<int64_t>(Settings.CaptureLimit);
+    if (captureDone && InstanceBenchmark.empty() && BenchFrames == 0) {
+        _closing = true;
+        if (!Headless)
+            glfwSetWindowShouldClose(_appWindow.Window, GLFW_TRUE);
+    }
+
+    if (Headless) {
+        // nothing to present, the in-flight fences alone pace the loop
+        _currentFrame = (_currentFrame + 1) % Settings.FramesInFlight;
+        return;
     }
 
     VkSwapchainKHR swapChains[] = {_swapchain};
@@ -1193,7 +1742,10 @@ void App::drawFrame() {
     presentInfo.pImageIndices = &imageIndex;
     presentInfo.pResults = nullptr;
 
-    result = vkQueuePresentKHR(_presentQueue, &presentInfo);
+    {
+        ProfileScope scope(&_profiler, "present", frame);
+        result = vkQueuePresentKHR(_presentQueue, &presentInfo);
+    }
     auto resized = _appDevice.FramebufferResized;
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || resized) {
@@ -1202,14 +1754,11 @@ void App::drawFrame() {
 	} else if (result != VK_SUCCESS) {
 		throw std::runtime_error("failed to present swap chain image!");
     } 
-    _currentFrame = (_currentFrame + 1) % _maxFramesInFlight;
+    _currentFrame = (_currentFrame + 1) % Settings.FramesInFlight;
 }
 
 void App::updateUniformBuffer(uint32_t currentImage) {
-    static auto startTime = std::chrono::high_resolution_clock::now();
-
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    auto time = static_cast<float>(_animationSeconds);
 
     UniformBufferObject ubo = {};
 	ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
@@ -1217,10 +1766,37 @@ void App::updateUniformBuffer(uint32_t currentImage) {
 	ubo.proj = glm::perspective(glm::radians(45.0f), _swapchainExtent.width / (float) _swapchainExtent.height, 0.1f, 10.0f);
 	ubo.proj[1][1] *= -1;
 
-	void* data;
-	vkMapMemory(_device, _uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
-	memcpy(data, &ubo, sizeof(ubo));
-	vkUnmapMemory(_device, _uniformBuffersMemory[currentImage]);
+	auto mapped = static_cast<char*>(_uniformBufferMemory.Mapped);
+	memcpy(mapped + uniformOffset(currentImage, 0), &ubo, sizeof(ubo));
+}
+
+void App::updateInstances(uint32_t currentImage) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    auto time = static_cast<float>(_animationSeconds);
+
+    // a square grid shrunk to the space a single copy used to take
+    auto side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(InstanceCount))));
+    float scale = 1.0f / side;
+
+    auto instances = reinterpret_cast<InstanceData*>(static_cast<char*>(_instanceBufferMemory.Mapped) + instanceOffset(currentImage));
+    for (uint32_t i = 0; i < InstanceCount; i++) {
+        // golden angle phases keep neighbours apart, instance 0 stays at identity
+        float phase = i * 2.39996323f;
+        float angle = phase + time * glm::radians(45.0f) * std::sin(phase);
+        float c = std::cos(angle) * scale;
+        float s = std::sin(angle) * scale;
+        float x = ((i % side) - (side - 1) * 0.5f) * 2.0f * scale;
+        float y = ((i / side) - (side - 1) * 0.5f) * 2.0f * scale;
+
+        instances[i].Model = glm::mat4(
+            c, s, 0.0f, 0.0f,
+            -s, c, 0.0f, 0.0f,
+            0.0f, 0.0f, scale, 0.0f,
+            x, y, 0.0f, 1.0f);
+        instances[i].TextureLayer = i % _textureLayers;
+    }
+
+    _instanceUpdateSeconds += std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
 }
 
 VkCommandBuffer App::beginSingleTimeCommands() {
@@ -1261,6 +1837,7 @@ void App::recreateSwapchain() {
     _appWindow.getWindowSize(&width, &height);
 
     vkDeviceWaitIdle(_device);
+    flushReadbacks();
 
     cleanupSwapchain();
 
@@ -1270,30 +1847,46 @@ void App::recreateSwapchain() {
     createGraphicsPipeline();
     createColorResources();
     createDepthResources();
+    createCullingPyramid();
+    _uploader.flush();
     createFramebuffers();
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSets();
+    createReadbackBuffers();
+
+    // the rings and their descriptors survive resizes unless the swapchain grew more images
+    if (_swapchainImages.size() > _uniformRingFrames) {
+        vkDestroyBuffer(_device, _uniformBuffer, nullptr);
+        _allocator.free(_uniformBufferMemory);
+        createUniformBuffers();
+        vkDestroyBuffer(_device, _instanceBuffer, nullptr);
+        _allocator.free(_instanceBufferMemory);
+        _culling.cleanupBuffers();
+        createInstanceBuffers();
+        writeDescriptorSet();
+    }
+
     createCommandBuffers();
 }
 
 void App::cleanupSwapchain() {
     vkDestroyImageView(_device, _colorImageView, nullptr);
     vkDestroyImage(_device, _colorImage, nullptr);
-    vkFreeMemory(_device, _colorImageMemory, nullptr);
+    _allocator.free(_colorImageMemory);
 
     vkDestroyImageView(_device, _depthImageView, nullptr);
     vkDestroyImage(_device, _depthImage, nullptr);
-    vkFreeMemory(_device, _depthImageMemory, nullptr);
+    _allocator.free(_depthImageMemory);
+    _culling.cleanupPyramid();
 
-    vkDestroyImage(_device, _offscreenImage, nullptr);
-    vkFreeMemory(_device, _offscreenImageMemory, nullptr);
+    for (size_t i = 0; i < _readbackBuffers.size(); i++) {
+        vkDestroyBuffer(_device, _readbackBuffers[i], nullptr);
+        _allocator.free(_readbackBuffersMemory[i]);
+    }
 
     for (size_t i = 0; i < _swapchainFramebuffers.size(); i++) {
         vkDestroyFramebuffer(_device, _swapchainFramebuffers[i], nullptr);
     }
 
-    vkFreeCommandBuffers(_device, _commandPool, static_cast<uint32_t>(_commandBuffers.size()), _commandBuffers.data());
+    _recorder.cleanupFrames();
 
     vkDestroyPipeline(_device, _graphicsPipeline, nullptr);
     vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
@@ -1303,93 +1896,109 @@ void App::cleanupSwapchain() {
         vkDestroyImageView(_device, _swapchainImageViews[i], nullptr);
     }
 
-    vkDestroySwapchainKHR(_device, _swapchain, nullptr);
-
-    for (size_t i = 0; i < _swapchainImages.size(); i++) {
-        vkDestroyBuffer(_device, _uniformBuffers[i], nullptr);
-        vkFreeMemory(_device, _uniformBuffersMemory[i], nullptr);
+    if (Headless) {
+        for (size_t i = 0; i < _swapchainImages.size(); i++) {
+            vkDestroyImage(_device, _swapchainImages[i], nullptr);
+            _allocator.free(_offscreenTargetsMemory[i]);
+        }
+    } else {
+        vkDestroySwapchainKHR(_device, _swapchain, nullptr);
     }
-
-    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
 }
 
 void App::saveFrame(uint32_t currentImage) {
-    VkImage srcImg = _swapchainImages[currentImage];
-    VkImage dstImg = _offscreenImage;
+    // the caller has waited on the fence of the submission that filled this slot
+    int64_t frame = _readbackFrames[currentImage];
+    if (frame < 0)
+        return;
+    _readbackFrames[currentImage] = -1;
 
     auto width = _swapchainExtent.width;
     auto height = _swapchainExtent.height;
+    auto data = static_cast<const char*>(_readbackMapped[currentImage]);
 
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+    if (_yuvConverter.Enabled && YuvCheck) {
+        checkYuvFrame(data);
+    }
 
-    // transition dstimg to transfer destination layout
-    transitionImageLayout(commandBuffer, dstImg, VK_FORMAT_R8G8B8A8_SRGB, 
-        0, VK_ACCESS_TRANSFER_WRITE_BIT,
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_IMAGE_ASPECT_COLOR_BIT, 1);
-
-    // transition swpchainimg from present to transfer source
-    transitionImageLayout(commandBuffer, srcImg, VK_FORMAT_R8G8B8A8_SRGB, 
-        VK_ACCESS_MEMORY_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT,
-        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_IMAGE_ASPECT_COLOR_BIT, 1);
-
-	// Define the region to blit (we will blit the whole swapchain image)
-	VkImageCopy imageCopyRegion{};
-	imageCopyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	imageCopyRegion.srcSubresource.layerCount = 1;
-	imageCopyRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	imageCopyRegion.dstSubresource.layerCount = 1;
-	imageCopyRegion.extent.width = width;
-	imageCopyRegion.extent.height = height;
-	imageCopyRegion.extent.depth = 1;
-
-	// Issue the copy command
-	vkCmdCopyImage(
-		commandBuffer,
-		srcImg, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		dstImg, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&imageCopyRegion);
-
-    // transition dstimg to general layout 
-    transitionImageLayout(commandBuffer, dstImg, VK_FORMAT_R8G8B8A8_SRGB, 
-        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_MEMORY_READ_BIT,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_IMAGE_ASPECT_COLOR_BIT, 1);
-
-    // transition swpchainimg from transfer source back to present
-    transitionImageLayout(commandBuffer, srcImg, VK_FORMAT_R8G8B8A8_SRGB, 
-        VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_MEMORY_READ_BIT,
-        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    // null when the writer is saturated and configured to skip frames
+    ImageWriterData* imgWriterData = _imageWriter->getNext();
+    if (imgWriterData) {
+        imgWriterData->Index = frame;
+        imgWriterData->Frame = _slotFrames[currentImage];
+        imgWriterData->Width = width;
+        imgWriterData->Height = height;
+        if (_yuvConverter.Enabled) {
+            // the planes as the compute pass laid them out, the writer threads drop the row padding
+            imgWriterData->Comp = 4;
+            imgWriterData->Pixels = ImageWriterPixels::Yuv420;
+            imgWriterData->Data.resize(_yuvConverter.layout().Size);
+            memcpy(imgWriterData->Data.data(), data, imgWriterData->Data.size());
+        } else {
+            // straight out of the mapped rows into the final pixel order, BMP and RGB captures drop alpha here too
+            bool dropAlpha = Capture == CaptureFormat::Bmp || (Capture == CaptureFormat::Raw && !CaptureAlpha);
+            imgWriterData->Comp = dropAlpha ? 3 : 4;
+            imgWriterData->Pixels = ImageWriterPixels::Rgba;
+            imgWriterData->Data.resize(static_cast<size_t>(width) * height * imgWriterData->Comp);
+            PixelConverter::convert(reinterpret_cast<const uint8_t*>(data + _readbackRgbaOffset), _readbackRowPitch, width, height, targetIsBgra(), dropAlpha, CaptureFlip,
+                reinterpret_cast<uint8_t*>(imgWriterData->Data.data()));
+        }
 
-    endSingleTimeCommands(commandBuffer);
+        _imageWriter->write(imgWriterData);
+    }
+}
 
-	// get memory
-    const char* data;
-	vkMapMemory(_device, _offscreenImageMemory, 0, VK_WHOLE_SIZE, 0, (void**)&data);
+void App::checkYuvFrame(const char* readback) {
+    auto gpuLayout = _yuvConverter.layout();
+    auto cpuLayout = Yuv420Layout::packed(gpuLayout.Width, gpuLayout.Height);
+    _yuvReference.resize(cpuLayout.Size);
+
+    // through the same swizzle and flip as an RGBA capture, then the reference conversion
+    _yuvCheckPixels.resize(static_cast<size_t>(gpuLayout.Width) * gpuLayout.Height * 4);
+    PixelConverter::convert(reinterpret_cast<const uint8_t*>(readback + _readbackRgbaOffset), _readbackRowPitch, gpuLayout.Width, gpuLayout.Height, targetIsBgra(), false, CaptureFlip,
+        _yuvCheckPixels.data());
+    Yuv420::convert(_yuvCheckPixels.data(), static_cast<size_t>(gpuLayout.Width) * 4, false, _yuvConverter.Coefficients, cpuLayout, _yuvReference.data());
+
+    int difference[3];
+    Yuv420::compare(reinterpret_cast<const uint8_t*>(readback), gpuLayout, _yuvReference.data(), cpuLayout, difference);
+    for (int i = 0; i < 3; i++) {
+        _yuvCheckMaxDifference[i] = std::max(_yuvCheckMaxDifference[i], difference[i]);
+    }
+    _yuvCheckFrames++;
+}
 
-    ImageWriterData* imgWriterData = _imageWriter.getNext();
-    imgWriterData->Index = _currentImage++;
-    imgWriterData->Width = width;
-    imgWriterData->Height = height;
-    imgWriterData->Comp = 4;
+bool App::targetIsBgra() const {
+    return _swapchainImageFormat == VK_FORMAT_B8G8R8A8_UNORM || _swapchainImageFormat == VK_FORMAT_B8G8R8A8_SRGB;
+}
 
-    memcpy((void*)imgWriterData->Data, data, static_cast<size_t>(width * height * 4));
+bool App::multisampled() const {
+    return _appDevice.DeviceMsaaSamples != VK_SAMPLE_COUNT_1_BIT;
+}
 
-    _imageWriter.write();
+void App::flushReadbacks() {
+    // only valid once the device is idle
+    for (uint32_t i = 0; i < _readbackFrames.size(); i++) {
+        resolveGpuTimes(i);
+        saveFrame(i);
+    }
+}
 
-	// Clean up resources
-	vkUnmapMemory(_device, _offscreenImageMemory);
+void App::resolveGpuTimes(uint32_t slot) {
+    uint64_t times[GpuTimestampCount];
+    if (!_gpuTimer.resolve(slot, times))
+        return;
 
-    // stop once done
-    if (_currentImage == 1000)
-        glfwSetWindowShouldClose(_appWindow.Window, GLFW_TRUE);
+    auto frame = _slotFrames[slot];
+    _profiler.recordGpu("gpu_frame", times[GpuFrameBegin], times[GpuReadbackEnd], frame);
+    if (_culling.Enabled) {
+        _profiler.recordGpu("gpu_cull", times[GpuFrameBegin], times[GpuRenderPassBegin], frame);
+    }
+    _profiler.recordGpu("gpu_render_pass", times[GpuRenderPassBegin], times[GpuRenderPassEnd], frame);
+    if (_culling.Enabled) {
+        // cull stats and the Hi-Z pyramid for the next frame
+        _profiler.recordGpu("gpu_pyramid", times[GpuRenderPassEnd], times[GpuReadbackBegin], frame);
+    }
+    _profiler.recordGpu("gpu_readback", times[GpuReadbackBegin], times[GpuReadbackEnd], frame);
 }
 
 void App::transitionImageLayout(
@@ -2,80 +2,96 @@
 
 #include <vulkan/vulkan.h>
 
-#define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtx/hash.hpp>
+#include "Vertex.h"
 
+#include "AnimationClock.h"
+#include "AppAllocator.h"
+#include "AppCommandRecorder.h"
+#include "AppCulling.h"
 #include "AppDevice.h"
+#include "AppGpuTimer.h"
+#include "AppPipelineCache.h"
+#include "AppUploader.h"
+#include "AppYuvConverter.h"
+#include "Config.h"
 #include "ImageWriter.h"
+#include "Ktx2File.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
+#include "PackedVertex.h"
+#include "Profiler.h"
+#include "TextureCache.h"
 
 #include <chrono>
+#include <memory>
 #include <vector>
 #include <array>
 #include <unordered_map>
 
-struct Vertex {
-    glm::vec3 pos;
-    glm::vec3 color;
-    glm::vec2 texCoord;
-
-    static VkVertexInputBindingDescription getBindingDescription() {
-        VkVertexInputBindingDescription bindingDescription = {};
-        bindingDescription.binding = 0;
-        bindingDescription.stride = sizeof(Vertex);
-        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-        return bindingDescription;
-    }
-
-    static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
-        std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions = {};
-
-        attributeDescriptions[0].binding = 0;
-		attributeDescriptions[0].location = 0;
-		attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[0].offset = offsetof(Vertex, pos);
-
-        attributeDescriptions[1].binding = 0;
-		attributeDescriptions[1].location = 1;
-		attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-		attributeDescriptions[1].offset = offsetof(Vertex, color);
-
-        attributeDescriptions[2].binding = 0;
-        attributeDescriptions[2].location = 2;
-        attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-        attributeDescriptions[2].offset = offsetof(Vertex, texCoord);
-
-        return attributeDescriptions;
-    }
-
-    bool operator==(const Vertex& other) const {
-		return pos == other.pos && color == other.color && texCoord == other.texCoord;
-	}
-};
-
-namespace std {
-    template<> struct hash<Vertex> {
-        size_t operator()(Vertex const& vertex) const {
-            return ((hash<glm::vec2>()(vertex.pos) ^
-                   (hash<glm::vec2>()(vertex.color) << 1)) >> 1) ^
-                   (hash<glm::vec1>()(vertex.texCoord) << 1);
-        }
-    };
-}
-
 struct UniformBufferObject {
     alignas(16) glm::mat4 model;
     alignas(16) glm::mat4 view;
     alignas(16) glm::mat4 proj;
 };
 
+// one per copy of the mesh, read by the vertex shader through gl_InstanceIndex
+struct InstanceData {
+    glm::mat4 Model;
+    uint32_t TextureLayer;
+    // std430 rounds the struct up to the matrix's 16 byte alignment
+    uint32_t Padding[3];
+};
+
+static_assert(sizeof(InstanceData) == 80, "InstanceData must match the std430 layout in shader.vert");
+
 class App {
 public: 
     void run();
 
+    // render into offscreen targets instead of a window and swapchain
+    bool Headless = false;
+    // size of the offscreen targets, a window follows its own size
+    uint32_t Width = 800;
+    uint32_t Height = 600;
+    // present mode, queue depths, MSAA, texture filtering and capture; read once by run()
+    Config Settings;
+    // layout the model is uploaded in, 12 byte PackedVertex or the 32 byte float Vertex
+    VertexFormat ModelVertexFormat = VertexFormat::Packed;
+    // copies of the mesh, all drawn by a single instanced draw unless GPU culling is on
+    uint32_t InstanceCount = 1;
+    // frustum and Hi-Z cull the copies in a compute pass and draw the survivors indirectly
+    bool GpuCulling = true;
+    bool OcclusionCulling = true;
+    // threads recording each frame's draws, 0 for one per core
+    unsigned RecordThreads = 0;
+    // instance counts to step through, timing a fixed number of frames at each instead of capturing
+    std::vector<uint32_t> InstanceBenchmark;
+    // how captured frames are saved; the target is a file, or a command reading Y4M on stdin for CaptureFormat::Pipe
+    CaptureFormat Capture = CaptureFormat::Y4m;
+    std::string CaptureTarget = "capture.y4m";
+    // Y4M captures: convert to YUV 4:2:0 in a compute pass before readback instead of on the writer threads
+    bool GpuYuv = true;
+    YuvMatrix CaptureMatrix = YuvMatrix::Bt601;
+    bool CaptureFullRange = true;
+    // also read back RGBA and compare every GPU converted frame against the CPU reference
+    bool YuvCheck = false;
+    // keep alpha in raw captures, BMP and Y4M never carry it
+    bool CaptureAlpha = true;
+    // bottom row first, for consumers that expect OpenGL's orientation
+    bool CaptureFlip = false;
+    // animate frame N at N / FixedFps seconds instead of by the wall clock, 0 for realtime; Y4M captures take the same rate
+    uint32_t FixedFps = 0;
+    // with a fixed step, the number of the first frame, to render one shard of a longer capture
+    uint64_t StartFrame = 0;
+    // write a Chrome trace of CPU scopes and GPU timestamps to <path>.json and per-frame times to <path>.csv
+    std::string ProfilePath;
+    // time this many frames after a warmup and report them as one JSON line, instead of running to the capture limit
+    uint32_t BenchFrames = 0;
+    std::string BenchName = "default";
+    // file the JSON line is appended to, stdout only when empty
+    std::string BenchOutput;
+
 private:
     void initVulkan();
     void mainLoop();
@@ -84,11 +100,12 @@ private:
     VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& available);
     VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
     void createSwapchain();
+    void createOffscreenTargets();
     void createImageViews();
-    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
+    VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D);
     void createDescriptorSetLayout();
+    void loadShaders();
     void createGraphicsPipeline();
-    VkShaderModule createShaderModule(const std::vector<char>& code);
     void createRenderPass();
     void createFramebuffers();
     void createCommandPool();
@@ -96,40 +113,65 @@ private:
     VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
     VkFormat findDepthFormat();
     bool hasStencilComponent(VkFormat format);
-    void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
+    // CPU side of the texture: mapped KTX2 or mip cache, or a freshly built mip chain
+    void loadTexture();
+    bool loadCompressedTexture();
     void createTextureImage();
     void createTextureImageView();
     void createTextureSampler();
     void createColorResources();
-    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-    void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-    void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
+    void createReadbackBuffers();
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, AppAllocation& bufferMemory, VkMemoryPropertyFlags preferredProperties = 0, AppAllocationStrategy strategy = AppAllocationStrategy::Buddy);
+    void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage& image, AppAllocation& imageMemory);
     void loadModel();
     void createVertexBuffer();
     void createIndexBuffer();
     void createUniformBuffers();
+    void createInstanceBuffers();
+    void createCullingPyramid();
     void createDescriptorPool();
     void createDescriptorSets();
+    void writeDescriptorSet();
+    uint32_t uniformOffset(uint32_t frame, uint32_t object);
+    uint32_t instanceOffset(uint32_t frame);
+    void setInstanceCount(uint32_t count);
+    void benchmarkInstances();
+    void benchmarkScenario();
+    bool multisampled() const;
     void createCommandBuffers();
+    VkCommandBuffer recordCommandBuffer(uint32_t imageIndex);
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t firstInstance, uint32_t instanceCount);
+    void recordReadback(VkCommandBuffer commandBuffer, uint32_t imageIndex);
     void createSyncObjects();
     void drawFrame();
     void saveFrame(uint32_t currentImage);
+    void checkYuvFrame(const char* readback);
+    bool targetIsBgra() const;
+    void flushReadbacks();
+    void resolveGpuTimes(uint32_t slot);
     void updateUniformBuffer(uint32_t currentImage);
+    void updateInstances(uint32_t currentImage);
     VkCommandBuffer beginSingleTimeCommands();
-    void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
     void transitionImageLayout(VkImage image, VkFormat format, VkAccessFlags sourceAccessFlags, VkAccessFlags destinationAccessFlags, VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, VkImageAspectFlags aspectFlags, uint32_t mipLevels); 
     void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkAccessFlags sourceAccessFlags, VkAccessFlags destinationAccessFlags, VkImageLayout oldLayout, VkImageLayout newLayout, VkPipelineStageFlags sourceStage, VkPipelineStageFlags destinationStage, VkImageAspectFlags aspectFlags, uint32_t mipLevels); 
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
     void endSingleTimeCommands(VkCommandBuffer commandBuffer);
     void recreateSwapchain();
     void cleanupSwapchain();
-
-    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    bool shouldClose();
 
     AppInstance _appInstance;
     AppWindow _appWindow;
     AppDevice _appDevice;
-    ImageWriter _imageWriter;
+    AppAllocator _allocator;
+    AppPipelineCache _pipelineCache;
+    AppCulling _culling;
+    AppUploader _uploader;
+    AppYuvConverter _yuvConverter;
+    AppGpuTimer _gpuTimer;
+    // before the writer, whose threads record into it until they are joined
+    Profiler _profiler;
+    // created by run(), which knows the configured backpressure
+    std::unique_ptr<ImageWriter> _imageWriter;
 
     VkPhysicalDevice _physicalDevice;
     VkDevice _device;
@@ -141,7 +183,15 @@ private:
     VkFormat _swapchainImageFormat;
     VkExtent2D _swapchainExtent;
     std::vector<VkImageView> _swapchainImageViews;
-
+    // headless only: backing memory of the offscreen targets in _swapchainImages
+    std::vector<AppAllocation> _offscreenTargetsMemory;
+    uint32_t _offscreenTargetIndex = 0;
+    // layout the target has to be in once the frame's commands are done
+    VkImageLayout _targetImageLayout;
+    bool _closing = false;
+
+    std::vector<char> _vertShaderCode;
+    std::vector<char> _fragShaderCode;
     VkShaderModule _vertShaderModule;
     VkShaderModule _fragShaderModule;
 
@@ -152,47 +202,105 @@ private:
 
     std::vector<VkFramebuffer> _swapchainFramebuffers;
     VkCommandPool _commandPool;
-    std::vector<VkCommandBuffer> _commandBuffers;
+    AppCommandRecorder _recorder;
 
     std::vector<Vertex> _vertices;
     std::vector<uint32_t> _indices;
+    // what gets uploaded: either _vertices/_indices or the mapped mesh cache
+    MeshCache _meshCache;
+    const Vertex* _meshVertices = nullptr;
+    size_t _vertexCount = 0;
+    const uint32_t* _meshIndices = nullptr;
+    size_t _indexCount = 0;
+    VkIndexType _indexType = VK_INDEX_TYPE_UINT32;
+    // picked by loadModel(), the vertex buffer and the pipeline's vertex input follow it
+    VertexFormat _meshVertexFormat = VertexFormat::Packed;
+    // push constants decoding the vertex buffer, identity for float vertices
+    MeshDecode _meshDecode;
     VkBuffer _vertexBuffer;
-    VkDeviceMemory _vertexBufferMemory;
+    AppAllocation _vertexBufferMemory;
     VkBuffer _indexBuffer;
-    VkDeviceMemory _indexBufferMemory;
-    std::vector<VkBuffer> _uniformBuffers;
-    std::vector<VkDeviceMemory> _uniformBuffersMemory;
+    AppAllocation _indexBufferMemory;
+    // persistently mapped uniform ring, one region per frame, bound with dynamic offsets
+    VkBuffer _uniformBuffer;
+    AppAllocation _uniformBufferMemory;
+    VkDeviceSize _uniformStride;
+    uint32_t _uniformRingFrames = 0;
+    // persistently mapped instance ring, one region of _instanceCapacity instances per target image
+    VkBuffer _instanceBuffer;
+    AppAllocation _instanceBufferMemory;
+    VkDeviceSize _instanceRegionSize;
+    uint32_t _instanceCapacity = 0;
+    uint32_t _instanceRingFrames = 0;
+    // CPU and fence time spent since the benchmark last reset them
+    double _instanceUpdateSeconds = 0.0;
+    double _fenceWaitSeconds = 0.0;
+    double _recordSeconds = 0.0;
+    // cull counters summed over the frames read back since the benchmark last reset them
+    CullStats _cullTotals = {};
+    uint32_t _cullFrames = 0;
 
     VkImage _colorImage;
-	VkDeviceMemory _colorImageMemory;
+	AppAllocation _colorImageMemory;
 	VkImageView _colorImageView;
 
     VkImage _depthImage;
     VkImageView _depthImageView;
-    VkDeviceMemory _depthImageMemory;
-
-    VkImage _offscreenImage;
-    VkDeviceMemory _offscreenImageMemory;
+    AppAllocation _depthImageMemory;
+
+    // readback ring, one persistently mapped host buffer per target image
+    std::vector<VkBuffer> _readbackBuffers;
+    std::vector<AppAllocation> _readbackBuffersMemory;
+    std::vector<void*> _readbackMapped;
+    // frame index waiting in each slot, -1 when the slot holds nothing new
+    std::vector<int64_t> _readbackFrames;
+    VkDeviceSize _readbackSize;
+    VkDeviceSize _readbackRowPitch;
+    // where the RGBA copy lands, behind the planes when the YUV pass is on
+    VkDeviceSize _readbackRgbaOffset = 0;
+    std::vector<uint8_t> _yuvReference;
+    std::vector<uint8_t> _yuvCheckPixels;
+    uint64_t _yuvCheckFrames = 0;
+    int _yuvCheckMaxDifference[3] = {};
+    // draw frame last recorded into each target image, what its readback and timestamps belong to
+    std::vector<int64_t> _slotFrames;
    
+    // loaded texture levels waiting for createTextureImage, backed by one of the three below
+    std::vector<TextureCache::Level> _textureLevels;
+    VkFormat _textureSourceFormat;
+    Ktx2File _compressedTexture;
+    TextureCache _textureCache;
+    std::vector<MipLevel> _textureMips;
+
     uint32_t _mipLevels;
+    VkFormat _textureFormat;
     VkImage _textureImage;
     VkImageView _textureImageView;
     VkSampler _textureSampler;
-    VkDeviceMemory _textureImageMemory;
+    AppAllocation _textureImageMemory;
+    // array layers in the texture view, instances pick one each
+    uint32_t _textureLayers = 1;
 
     VkDescriptorPool _descriptorPool;
-    std::vector<VkDescriptorSet> _descriptorSets;
+    VkDescriptorSet _descriptorSet;
 
     std::vector<VkSemaphore> _imageAvailableSemaphores;
     std::vector<VkSemaphore> _renderFinishedSemaphores;
     std::vector<VkFence> _inFlightFences;
     std::vector<VkFence> _imagesInFlight;
     int _currentFrame;
-    int _currentImage = 1;
-
-    static const int _maxFramesInFlight;
+    int64_t _currentImage = 1;
+    // frames drawn so far, the frame number profile events are filed under and the animation clock runs on
+    int64_t _frameNumber = 0;
+    AnimationClock _clock;
+    // animation time of the frame being drawn
+    double _animationSeconds = 0.0;
+
+    static const uint32_t _maxUniformObjects;
     static const std::string _modelPath;
     static const std::string _texturePath;
+    static const std::string _compressedTexturePath;
+    static const std::string _pipelineCachePath;
 };
 
 
@@ -0,0 +1,304 @@
+#include "AppAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    // smallest buddy node, also the granularity of the free lists
+    const VkDeviceSize minNodeSize = 256;
+
+    VkDeviceSize nextPowerOfTwo(VkDeviceSize n) {
+        VkDeviceSize p = 1;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    VkDeviceSize alignUp(VkDeviceSize n, VkDeviceSize alignment) {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    uint32_t orderOf(VkDeviceSize nodeSize) {
+        uint32_t order = 0;
+        while ((minNodeSize << order) < nodeSize)
+            order++;
+        return order;
+    }
+}
+
+void AppAllocator::init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize) {
+    _physicalDevice = physicalDevice;
+    _device = device;
+    _preferredBlockSize = nextPowerOfTwo(preferredBlockSize);
+
+    vkGetPhysicalDeviceMemoryProperties(_physicalDevice, &_memoryProperties);
+}
+
+void AppAllocator::cleanup() {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for (auto& pool : _pools) {
+        for (auto& block : pool.second) {
+            destroyBlock(block.get());
+        }
+    }
+    for (auto& block : _dedicated) {
+        destroyBlock(block.get());
+    }
+    _pools.clear();
+    _dedicated.clear();
+}
+
+AppAllocation AppAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferredProperties, bool linearResource, AppAllocationStrategy strategy) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties, preferredProperties);
+    auto blockSize = blockSizeFor(memoryTypeIndex);
+
+    AppAllocation allocation;
+
+    // big resources would waste most of a buddy node, give them their own memory
+    if (requirements.size > blockSize / 2) {
+        auto block = createBlock(memoryTypeIndex, requirements.size, strategy, true);
+        block->LinearResources = linearResource;
+        _dedicated.emplace_back(block);
+
+        allocateFromBlock(block, requirements.size, requirements.alignment, allocation);
+        return allocation;
+    }
+
+    auto& pool = _pools[PoolKey(memoryTypeIndex, strategy, linearResource)];
+    for (auto& block : pool) {
+        if (allocateFromBlock(block.get(), requirements.size, requirements.alignment, allocation))
+            return allocation;
+    }
+
+    auto block = createBlock(memoryTypeIndex, blockSize, strategy, false);
+    block->LinearResources = linearResource;
+    pool.emplace_back(block);
+
+    if (!allocateFromBlock(block, requirements.size, requirements.alignment, allocation)) {
+        throw std::runtime_error("failed to sub-allocate from a fresh memory block!");
+    }
+    return allocation;
+}
+
+void AppAllocator::free(AppAllocation& allocation) {
+    if (allocation.Block == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto block = allocation.Block;
+    block->Allocations--;
+
+    if (block->Strategy == AppAllocationStrategy::Buddy && !block->Dedicated) {
+        block->Used -= allocation.NodeSize;
+
+        // merge with the buddy for as long as it is free too
+        auto offset = allocation.Offset;
+        auto nodeSize = allocation.NodeSize;
+        auto order = orderOf(nodeSize);
+        while (nodeSize < block->Size) {
+            auto buddy = offset ^ nodeSize;
+            auto& freeNodes = block->FreeNodes[order];
+            auto it = freeNodes.find(buddy);
+            if (it == freeNodes.end())
+                break;
+            freeNodes.erase(it);
+            offset = std::min(offset, buddy);
+            nodeSize <<= 1;
+            order++;
+        }
+        block->FreeNodes[order].insert(offset);
+    } else {
+        block->Used -= allocation.Size;
+        if (block->Allocations == 0)
+            block->Head = 0;
+    }
+
+    allocation = AppAllocation();
+
+    if (block->Allocations > 0)
+        return;
+
+    if (block->Dedicated) {
+        auto it = std::find_if(_dedicated.begin(), _dedicated.end(), [block](const std::unique_ptr<AppMemoryBlock>& b) { return b.get() == block; });
+        destroyBlock(block);
+        _dedicated.erase(it);
+        return;
+    }
+
+    // keep one empty block per pool around so staging churn does not hit vkAllocateMemory
+    auto& pool = _pools[PoolKey(block->MemoryTypeIndex, block->Strategy, block->LinearResources)];
+    auto empty = std::count_if(pool.begin(), pool.end(), [](const std::unique_ptr<AppMemoryBlock>& b) { return b->Allocations == 0; });
+    if (empty > 1) {
+        auto it = std::find_if(pool.begin(), pool.end(), [block](const std::unique_ptr<AppMemoryBlock>& b) { return b.get() == block; });
+        destroyBlock(block);
+        pool.erase(it);
+    }
+}
+
+AppAllocatorStats AppAllocator::getStats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    AppAllocatorStats stats = {};
+    VkDeviceSize totalFree = 0;
+    VkDeviceSize largestFree = 0;
+
+    auto account = [&](const AppMemoryBlock* block) {
+        stats.BytesReserved += block->Size;
+        stats.BytesUsed += block->Used;
+        stats.BlockCount++;
+        stats.AllocationCount += block->Allocations;
+
+        if (block->Dedicated)
+            return;
+
+        if (block->Strategy == AppAllocationStrategy::Buddy) {
+            for (uint32_t order = 0; order < block->FreeNodes.size(); order++) {
+                auto nodeSize = minNodeSize << order;
+                totalFree += nodeSize * block->FreeNodes[order].size();
+                if (!block->FreeNodes[order].empty())
+                    largestFree = std::max(largestFree, nodeSize);
+            }
+        } else {
+            // space freed behind the head only comes back once the block empties
+            totalFree += block->Size - block->Used;
+            largestFree = std::max(largestFree, block->Size - block->Head);
+        }
+    };
+
+    for (auto& pool : _pools) {
+        for (auto& block : pool.second) {
+            account(block.get());
+        }
+    }
+    for (auto& block : _dedicated) {
+        account(block.get());
+    }
+
+    stats.Fragmentation = totalFree > 0 ? 1.0f - static_cast<float>(largestFree) / static_cast<float>(totalFree) : 0.0f;
+    return stats;
+}
+
+uint32_t AppAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+	for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) && (_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+	throw std::runtime_error("failed to find suitable memory type!");
+}
+
+uint32_t AppAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferredProperties) {
+    if (preferredProperties != 0) {
+        auto wanted = properties | preferredProperties;
+        for (uint32_t i = 0; i < _memoryProperties.memoryTypeCount; i++) {
+            if ((typeFilter & (1 << i)) && (_memoryProperties.memoryTypes[i].propertyFlags & wanted) == wanted) {
+                return i;
+            }
+        }
+    }
+    return findMemoryType(typeFilter, properties);
+}
+
+AppMemoryBlock* AppAllocator::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, AppAllocationStrategy strategy, bool dedicated) {
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    auto block = new AppMemoryBlock();
+    if (vkAllocateMemory(_device, &allocInfo, nullptr, &block->Memory) != VK_SUCCESS) {
+        delete block;
+        throw std::runtime_error("failed to allocate memory block!");
+    }
+
+    block->Size = size;
+    block->Mapped = nullptr;
+    block->MemoryTypeIndex = memoryTypeIndex;
+    block->Strategy = strategy;
+    block->LinearResources = true;
+    block->Dedicated = dedicated;
+    block->Allocations = 0;
+    block->Used = 0;
+    block->Head = 0;
+
+    if (strategy == AppAllocationStrategy::Buddy && !dedicated) {
+        block->FreeNodes.resize(orderOf(size) + 1);
+        block->FreeNodes.back().insert(0);
+    }
+
+    if (_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        vkMapMemory(_device, block->Memory, 0, VK_WHOLE_SIZE, 0, &block->Mapped);
+    }
+
+    return block;
+}
+
+void AppAllocator::destroyBlock(AppMemoryBlock* block) {
+    if (block->Mapped)
+        vkUnmapMemory(_device, block->Memory);
+    vkFreeMemory(_device, block->Memory, nullptr);
+}
+
+bool AppAllocator::allocateFromBlock(AppMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, AppAllocation& allocation) {
+    VkDeviceSize offset = 0;
+    VkDeviceSize nodeSize = 0;
+
+    if (block->Dedicated) {
+        if (block->Allocations > 0)
+            return false;
+        block->Used = size;
+    } else if (block->Strategy == AppAllocationStrategy::Buddy) {
+        // nodes are aligned to their own size, so rounding up to the alignment is enough
+        nodeSize = std::max(nextPowerOfTwo(std::max(size, alignment)), minNodeSize);
+        if (nodeSize > block->Size)
+            return false;
+
+        auto order = orderOf(nodeSize);
+        auto available = order;
+        while (available < block->FreeNodes.size() && block->FreeNodes[available].empty())
+            available++;
+        if (available == block->FreeNodes.size())
+            return false;
+
+        offset = *block->FreeNodes[available].begin();
+        block->FreeNodes[available].erase(block->FreeNodes[available].begin());
+
+        // split down, handing the upper halves back to the free lists
+        while (available > order) {
+            available--;
+            block->FreeNodes[available].insert(offset + (minNodeSize << available));
+        }
+        block->Used += nodeSize;
+    } else {
+        offset = alignUp(block->Head, alignment);
+        if (offset + size > block->Size)
+            return false;
+        block->Head = offset + size;
+        block->Used += size;
+    }
+
+    block->Allocations++;
+
+    allocation.Memory = block->Memory;
+    allocation.Offset = offset;
+    allocation.Size = size;
+    allocation.Mapped = block->Mapped ? static_cast<char*>(block->Mapped) + offset : nullptr;
+    allocation.Block = block;
+    allocation.NodeSize = nodeSize;
+    return true;
+}
+
+VkDeviceSize AppAllocator::blockSizeFor(uint32_t memoryTypeIndex) {
+    // small heaps (e.g. host-visible device-local on discrete GPUs) get smaller blocks
+    auto heapIndex = _memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+    auto heapSize = _memoryProperties.memoryHeaps[heapIndex].size;
+
+    auto blockSize = _preferredBlockSize;
+    while (blockSize > minNodeSize && blockSize > heapSize / 8)
+        blockSize >>= 1;
+    return blockSize;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <tuple>
+#include <vector>
+
+// How a pool carves its blocks.
+//   Buddy:  power-of-two nodes that split and merge, for long-lived resources
+//   Linear: bump pointer that rewinds once the block is empty, for staging
+enum class AppAllocationStrategy {
+    Buddy,
+    Linear
+};
+
+struct AppMemoryBlock {
+    VkDeviceMemory Memory;
+    VkDeviceSize Size;
+    void* Mapped;
+    uint32_t MemoryTypeIndex;
+    AppAllocationStrategy Strategy;
+    // holds buffers and linear images rather than optimal images
+    bool LinearResources;
+    // a single resource too large to share a block
+    bool Dedicated;
+
+    uint32_t Allocations;
+    VkDeviceSize Used;
+
+    // buddy: free node offsets per order, order 0 being the smallest node
+    std::vector<std::set<VkDeviceSize>> FreeNodes;
+    // linear: next free byte
+    VkDeviceSize Head;
+};
+
+struct AppAllocation {
+    VkDeviceMemory Memory = VK_NULL_HANDLE;
+    VkDeviceSize Offset = 0;
+    VkDeviceSize Size = 0;
+    // non-null for host-visible memory, blocks stay mapped for their whole lifetime
+    void* Mapped = nullptr;
+
+    AppMemoryBlock* Block = nullptr;
+    VkDeviceSize NodeSize = 0;
+};
+
+struct AppAllocatorStats {
+    VkDeviceSize BytesReserved;
+    VkDeviceSize BytesUsed;
+    uint32_t BlockCount;
+    uint32_t AllocationCount;
+    // 1 - largest free range / total free bytes, 0 when free space is contiguous
+    float Fragmentation;
+};
+
+// Sub-allocates buffers and images out of large VkDeviceMemory blocks.
+// Blocks are grouped by memory type, strategy and resource kind. Linear
+// resources (buffers, linear images) never share a block with optimal images,
+// so bufferImageGranularity can never be violated between neighbours.
+class AppAllocator {
+public:
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize preferredBlockSize = 64 * 1024 * 1024);
+    void cleanup();
+
+    AppAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferredProperties, bool linearResource, AppAllocationStrategy strategy);
+    void free(AppAllocation& allocation);
+
+    AppAllocatorStats getStats();
+
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    // falls back to properties alone when no type also has preferredProperties
+    uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, VkMemoryPropertyFlags preferredProperties);
+
+private:
+    typedef std::tuple<uint32_t, AppAllocationStrategy, bool> PoolKey;
+
+    AppMemoryBlock* createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, AppAllocationStrategy strategy, bool dedicated);
+    void destroyBlock(AppMemoryBlock* block);
+    bool allocateFromBlock(AppMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, AppAllocation& allocation);
+    VkDeviceSize blockSizeFor(uint32_t memoryTypeIndex);
+
+    VkPhysicalDevice _physicalDevice;
+    VkDevice _device;
+    VkPhysicalDeviceMemoryProperties _memoryProperties;
+    VkDeviceSize _preferredBlockSize;
+
+    std::map<PoolKey, std::vector<std::unique_ptr<AppMemoryBlock>>> _pools;
+    std::vector<std::unique_ptr<AppMemoryBlock>> _dedicated;
+    std::mutex _mutex;
+};
@@ -0,0 +1,113 @@
+#include "AppCommandRecorder.h"
+
+#include <stdexcept>
+
+void AppCommandRecorder::init(VkDevice device, uint32_t queueFamily) {
+    _device = device;
+    _queueFamily = queueFamily;
+    _workers.reset(new WorkerPool(Threads));
+}
+
+void AppCommandRecorder::cleanup() {
+    cleanupFrames();
+    _workers.reset();
+}
+
+VkCommandPool AppCommandRecorder::createPool() {
+    // transient: everything is re-recorded every frame, and only ever reset as a whole
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = _queueFamily;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    VkCommandPool pool;
+    if (vkCreateCommandPool(_device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create command pool!");
+    }
+    return pool;
+}
+
+VkCommandBuffer AppCommandRecorder::allocate(VkCommandPool pool, VkCommandBufferLevel level) {
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = pool;
+    allocInfo.level = level;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    if (vkAllocateCommandBuffers(_device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate command buffers!");
+    }
+    return commandBuffer;
+}
+
+void AppCommandRecorder::createFrames(uint32_t frames) {
+    auto threads = threadCount();
+
+    _frames.resize(frames);
+    for (auto& frame : _frames) {
+        frame.PrimaryPool = createPool();
+        frame.Primary = allocate(frame.PrimaryPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+        frame.Pools.resize(threads);
+        frame.Secondaries.resize(threads);
+        for (unsigned t = 0; t < threads; t++) {
+            frame.Pools[t] = createPool();
+            frame.Secondaries[t] = allocate(frame.Pools[t], VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+        }
+    }
+}
+
+void AppCommandRecorder::cleanupFrames() {
+    // destroying a pool frees its command buffers with it
+    for (auto& frame : _frames) {
+        vkDestroyCommandPool(_device, frame.PrimaryPool, nullptr);
+        for (auto pool : frame.Pools) {
+            vkDestroyCommandPool(_device, pool, nullptr);
+        }
+    }
+    _frames.clear();
+}
+
+VkCommandBuffer AppCommandRecorder::beginPrimary(uint32_t frame) {
+    auto& commands = _frames[frame];
+    vkResetCommandPool(_device, commands.PrimaryPool, 0);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commands.Primary, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("failed to begin recording command buffer!");
+    }
+    return commands.Primary;
+}
+
+void AppCommandRecorder::recordSecondaries(uint32_t frame, VkRenderPass renderPass, VkFramebuffer framebuffer, const std::function<void(VkCommandBuffer, unsigned)>& record) {
+    auto& commands = _frames[frame];
+
+    _workers->run([&](unsigned thread) {
+        // each thread only ever touches its own pool
+        vkResetCommandPool(_device, commands.Pools[thread], 0);
+
+        VkCommandBufferInheritanceInfo inheritanceInfo = {};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = framebuffer;
+
+        VkCommandBufferBeginInfo beginInfo = {};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        auto commandBuffer = commands.Secondaries[thread];
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        record(commandBuffer, thread);
+        vkEndCommandBuffer(commandBuffer);
+    });
+}
+
+void AppCommandRecorder::executeSecondaries(VkCommandBuffer primary, uint32_t frame) {
+    auto& commands = _frames[frame];
+    vkCmdExecuteCommands(primary, static_cast<uint32_t>(commands.Secondaries.size()), commands.Secondaries.data());
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "WorkerPool.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Per-frame command recording spread over a WorkerPool. Every target image
+// owns one transient pool for its primary and one per thread for the
+// secondaries, so threads never share a pool and whole pools are reset
+// each frame instead of freeing individual command buffers.
+class AppCommandRecorder {
+public:
+    // recording threads, the calling thread included; 0 picks one per core
+    unsigned Threads = 0;
+
+    void init(VkDevice device, uint32_t queueFamily);
+    void cleanup();
+
+    // command pools and buffers for frames target images, rebuilt with the swapchain
+    void createFrames(uint32_t frames);
+    void cleanupFrames();
+
+    unsigned threadCount() const { return _workers->threadCount(); }
+
+    // resets every pool of the frame and begins its primary command buffer
+    VkCommandBuffer beginPrimary(uint32_t frame);
+    // records one secondary per thread inside the render pass, record(commandBuffer, thread) runs on that thread
+    void recordSecondaries(uint32_t frame, VkRenderPass renderPass, VkFramebuffer framebuffer, const std::function<void(VkCommandBuffer, unsigned)>& record);
+    // executes the secondaries in thread order, inside a pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+    void executeSecondaries(VkCommandBuffer primary, uint32_t frame);
+
+private:
+    struct FrameCommands {
+        VkCommandPool PrimaryPool;
+        VkCommandBuffer Primary;
+        // indexed by thread
+        std::vector<VkCommandPool> Pools;
+        std::vector<VkCommandBuffer> Secondaries;
+    };
+
+    VkCommandPool createPool();
+    VkCommandBuffer allocate(VkCommandPool pool, VkCommandBufferLevel level);
+
+    VkDevice _device;
+    uint32_t _queueFamily;
+    std::unique_ptr<WorkerPool> _workers;
+    std::vector<FrameCommands> _frames;
+};
@@ -0,0 +1,596 @@
+#include "AppCulling.h"
+#include "Shaders.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using std::cout;
+using std::endl;
+
+namespace {
+    VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    uint32_t previousPowerOfTwo(uint32_t value) {
+        uint32_t result = 1;
+        while (result * 2 <= value) {
+            result *= 2;
+        }
+        return result;
+    }
+
+    uint32_t groupCount(uint32_t size, uint32_t groupSize) {
+        return (size + groupSize - 1) / groupSize;
+    }
+}
+
+const uint32_t AppCulling::MaxPyramidLevels;
+
+void AppCulling::init(AppDevice* device, AppAllocator* allocator, VkPipelineCache pipelineCache, VkFormat depthFormat) {
+    _device = device->Device;
+    _allocator = allocator;
+    _samples = device->DeviceMsaaSamples;
+    vkGetPhysicalDeviceProperties(device->PhysicalDevice, &_properties);
+
+    // one command per object needs both, without them everything stays in the single instanced draw
+    if (Enabled && (!device->MultiDrawIndirect || !device->DrawIndirectFirstInstance)) {
+        cout << "GPU culling disabled: multiDrawIndirect and drawIndirectFirstInstance are required" << endl;
+        Enabled = false;
+    }
+    if (!Enabled)
+        return;
+
+    DrawCount = device->DrawIndirectCount;
+    if (DrawCount) {
+        _vkCmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR) vkGetDeviceProcAddr(_device, "vkCmdDrawIndexedIndirectCountKHR");
+        DrawCount = _vkCmdDrawIndexedIndirectCount != nullptr;
+    }
+
+    if (Occlusion) {
+        VkFormatProperties formatProperties;
+        vkGetPhysicalDeviceFormatProperties(device->PhysicalDevice, depthFormat, &formatProperties);
+        if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+            cout << "occlusion culling disabled: the depth format can't be sampled" << endl;
+            Occlusion = false;
+        }
+    }
+
+    createDescriptorSetLayouts();
+    createPipelines(pipelineCache);
+    createDescriptorSets();
+
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(MaxPyramidLevels);
+
+    if (vkCreateSampler(_device, &samplerInfo, nullptr, &_sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create culling sampler!");
+    }
+
+    cout << "GPU culling: " << (Occlusion ? "frustum and Hi-Z occlusion" : "frustum only") << ", "
+         << (DrawCount ? "compacted draws with indirect count" : "one indirect command per object") << endl;
+}
+
+void AppCulling::cleanup() {
+    if (!Enabled)
+        return;
+
+    cleanupPyramid();
+    cleanupBuffers();
+
+    vkDestroySampler(_device, _sampler, nullptr);
+    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+
+    vkDestroyPipeline(_device, _cullPipeline, nullptr);
+    vkDestroyPipeline(_device, _initPipeline, nullptr);
+    vkDestroyPipeline(_device, _reducePipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _cullPipelineLayout, nullptr);
+    vkDestroyPipelineLayout(_device, _initPipelineLayout, nullptr);
+    vkDestroyPipelineLayout(_device, _reducePipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _cullSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _initSetLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _reduceSetLayout, nullptr);
+}
+
+void AppCulling::createDescriptorSetLayouts() {
+    // uniforms, instances, draws and counters, all four bound with dynamic offsets, then the pyramid
+    std::array<VkDescriptorSetLayoutBinding, 5> cullBindings = {};
+    for (uint32_t i = 0; i < cullBindings.size(); i++) {
+        cullBindings[i].binding = i;
+        cullBindings[i].descriptorCount = 1;
+        cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    cullBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    cullBindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    // source then destination level
+    std::array<VkDescriptorSetLayoutBinding, 2> pyramidBindings = {};
+    for (uint32_t i = 0; i < pyramidBindings.size(); i++) {
+        pyramidBindings[i].binding = i;
+        pyramidBindings[i].descriptorCount = 1;
+        pyramidBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        pyramidBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+    layoutInfo.pBindings = cullBindings.data();
+    if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_cullSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull descriptor set layout!");
+    }
+
+    layoutInfo.bindingCount = static_cast<uint32_t>(pyramidBindings.size());
+    layoutInfo.pBindings = pyramidBindings.data();
+    if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_reduceSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pyramid descriptor set layout!");
+    }
+
+    // the first level reads the depth attachment through a sampler instead
+    pyramidBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    if (vkCreateDescriptorSetLayout(_device, &layoutInfo, nullptr, &_initSetLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pyramid descriptor set layout!");
+    }
+}
+
+void AppCulling::createPipelines(VkPipelineCache pipelineCache) {
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstants);
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &_cullSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &_cullPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create cull pipeline layout!");
+    }
+
+    pushConstantRange.size = sizeof(HiZPushConstants);
+    layoutInfo.pSetLayouts = &_initSetLayout;
+    if (vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &_initPipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pyramid pipeline layout!");
+    }
+
+    layoutInfo.pSetLayouts = &_reduceSetLayout;
+    if (vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &_reducePipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pyramid pipeline layout!");
+    }
+
+    _cullPipeline = Shaders::createComputePipeline(_device, pipelineCache, "shaders/cull.spv", _cullPipelineLayout);
+    // a multisampled attachment needs a sampler2DMS, so the first level comes in two builds
+    _initPipeline = Shaders::createComputePipeline(_device, pipelineCache, _samples == VK_SAMPLE_COUNT_1_BIT ? "shaders/hiz_init.spv" : "shaders/hiz_init_ms.spv", _initPipelineLayout);
+    _reducePipeline = Shaders::createComputePipeline(_device, pipelineCache, "shaders/hiz_reduce.spv", _reducePipelineLayout);
+}
+
+void AppCulling::createDescriptorSets() {
+    std::array<VkDescriptorPoolSize, 4> poolSizes = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    poolSizes[1].descriptorCount = 3;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount = 2;
+    poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[3].descriptorCount = 1 + 2 * MaxPyramidLevels;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 2 + MaxPyramidLevels;
+
+    if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create culling descriptor pool!");
+    }
+
+    std::array<VkDescriptorSetLayout, 2 + MaxPyramidLevels> layouts;
+    layouts[0] = _cullSetLayout;
+    layouts[1] = _initSetLayout;
+    std::fill(layouts.begin() + 2, layouts.end(), _reduceSetLayout);
+
+    std::array<VkDescriptorSet, 2 + MaxPyramidLevels> sets;
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    allocInfo.pSetLayouts = layouts.data();
+
+    if (vkAllocateDescriptorSets(_device, &allocInfo, sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate culling descriptor sets!");
+    }
+
+    _cullSet = sets[0];
+    _initSet = sets[1];
+    std::copy(sets.begin() + 2, sets.end(), _reduceSets.begin());
+}
+
+void AppCulling::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, AppAllocation& memory) {
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(_device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create culling buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(_device, buffer, &memRequirements);
+
+    memory = _allocator->allocate(memRequirements, properties, 0, true, AppAllocationStrategy::Buddy);
+
+    vkBindBufferMemory(_device, buffer, memory.Memory, memory.Offset);
+}
+
+void AppCulling::setMesh(const Vertex* vertices, size_t vertexCount, size_t indexCount) {
+    _indexCount = static_cast<uint32_t>(indexCount);
+    if (vertexCount == 0)
+        return;
+
+    // centered on the bounding box, which is close enough to the minimal sphere for culling
+    glm::vec3 minPos = vertices[0].pos;
+    glm::vec3 maxPos = vertices[0].pos;
+    for (size_t i = 1; i < vertexCount; i++) {
+        for (int k = 0; k < 3; k++) {
+            minPos[k] = std::min(minPos[k], vertices[i].pos[k]);
+            maxPos[k] = std::max(maxPos[k], vertices[i].pos[k]);
+        }
+    }
+    auto center = (minPos + maxPos) * 0.5f;
+
+    float radius = 0.0f;
+    for (size_t i = 0; i < vertexCount; i++) {
+        radius = std::max(radius, glm::length(vertices[i].pos - center));
+    }
+
+    _sphere = glm::vec4(center, radius);
+}
+
+void AppCulling::createBuffers(uint32_t capacity, uint32_t frames) {
+    if (!Enabled)
+        return;
+
+    auto alignment = _properties.limits.minStorageBufferOffsetAlignment;
+    _capacity = capacity;
+    _drawRegionSize = alignUp(sizeof(VkDrawIndexedIndirectCommand) * capacity, alignment);
+    _counterRegionSize = alignUp(sizeof(CullStats), alignment);
+
+    createBuffer(_drawRegionSize * frames, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _drawBuffer, _drawBufferMemory);
+    createBuffer(_counterRegionSize * frames, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _counterBuffer, _counterBufferMemory);
+    // counters are copied out after the frame, the atomics themselves stay in device memory
+    createBuffer(sizeof(CullStats) * frames, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, _statsBuffer, _statsBufferMemory);
+    memset(_statsBufferMemory.Mapped, 0, sizeof(CullStats) * frames);
+}
+
+void AppCulling::cleanupBuffers() {
+    if (_drawBuffer == VK_NULL_HANDLE)
+        return;
+
+    vkDestroyBuffer(_device, _drawBuffer, nullptr);
+    _allocator->free(_drawBufferMemory);
+    vkDestroyBuffer(_device, _counterBuffer, nullptr);
+    _allocator->free(_counterBufferMemory);
+    vkDestroyBuffer(_device, _statsBuffer, nullptr);
+    _allocator->free(_statsBufferMemory);
+    _drawBuffer = VK_NULL_HANDLE;
+}
+
+void AppCulling::createPyramid(VkCommandBuffer commandBuffer, VkImageView depthView, VkExtent2D extent) {
+    if (!Enabled)
+        return;
+
+    // power of two levels halve exactly, so a texel's footprint in uv is the same at every level
+    _depthExtent = extent;
+    _pyramidExtent = {1, 1};
+    uint32_t levels = 1;
+    if (Occlusion) {
+        _pyramidExtent = {previousPowerOfTwo(extent.width), previousPowerOfTwo(extent.height)};
+        levels = static_cast<uint32_t>(std::floor(std::log2(std::max(_pyramidExtent.width, _pyramidExtent.height)))) + 1;
+        levels = std::min(levels, MaxPyramidLevels);
+    }
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent.width = _pyramidExtent.width;
+    imageInfo.extent.height = _pyramidExtent.height;
+    imageInfo.extent.depth = 1;
+    imageInfo.mipLevels = levels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateImage(_device, &imageInfo, nullptr, &_pyramid) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(_device, _pyramid, &memRequirements);
+    _pyramidMemory = _allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, false, AppAllocationStrategy::Buddy);
+    vkBindImageMemory(_device, _pyramid, _pyramidMemory.Memory, _pyramidMemory.Offset);
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = _pyramid;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R32_SFLOAT;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.baseMipLevel = 0;
+    viewInfo.subresourceRange.levelCount = levels;
+    viewInfo.subresourceRange.baseArrayLayer = 0;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(_device, &viewInfo, nullptr, &_pyramidView) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create depth pyramid view!");
+    }
+
+    // storage images bind a single level each
+    _pyramidLevelViews.resize(levels);
+    viewInfo.subresourceRange.levelCount = 1;
+    for (uint32_t i = 0; i < levels; i++) {
+        viewInfo.subresourceRange.baseMipLevel = i;
+        if (vkCreateImageView(_device, &viewInfo, nullptr, &_pyramidLevelViews[i]) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create depth pyramid view!");
+        }
+    }
+
+    // the pyramid lives in GENERAL, and starts at the far plane so the first frame occludes nothing
+    VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1};
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = _pyramid;
+    barrier.subresourceRange = range;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkClearColorValue farPlane = {{1.0f, 1.0f, 1.0f, 1.0f}};
+    vkCmdClearColorImage(commandBuffer, _pyramid, VK_IMAGE_LAYOUT_GENERAL, &farPlane, 1, &range);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkDescriptorImageInfo pyramidInfo = {};
+    pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+    pyramidInfo.imageView = _pyramidView;
+    pyramidInfo.sampler = _sampler;
+
+    VkWriteDescriptorSet pyramidWrite = {};
+    pyramidWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    pyramidWrite.dstSet = _cullSet;
+    pyramidWrite.dstBinding = 4;
+    pyramidWrite.dstArrayElement = 0;
+    pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pyramidWrite.descriptorCount = 1;
+    pyramidWrite.pImageInfo = &pyramidInfo;
+    vkUpdateDescriptorSets(_device, 1, &pyramidWrite, 0, nullptr);
+
+    if (!Occlusion)
+        return;
+
+    // level 0 from the depth attachment, every other level from the one below
+    std::vector<VkDescriptorImageInfo> imageInfos(2 * levels);
+    std::vector<VkWriteDescriptorSet> writes(2 * levels);
+    for (uint32_t i = 0; i < levels; i++) {
+        auto& srcInfo = imageInfos[2 * i];
+        auto& dstInfo = imageInfos[2 * i + 1];
+        auto set = i == 0 ? _initSet : _reduceSets[i];
+
+        if (i == 0) {
+            srcInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+            srcInfo.imageView = depthView;
+            srcInfo.sampler = _sampler;
+        } else {
+            srcInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            srcInfo.imageView = _pyramidLevelViews[i - 1];
+        }
+        dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        dstInfo.imageView = _pyramidLevelViews[i];
+
+        for (uint32_t binding = 0; binding < 2; binding++) {
+            auto& write = writes[2 * i + binding];
+            write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write.dstSet = set;
+            write.dstBinding = binding;
+            write.dstArrayElement = 0;
+            write.descriptorType = i == 0 && binding == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write.descriptorCount = 1;
+            write.pImageInfo = &imageInfos[2 * i + binding];
+        }
+    }
+    vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void AppCulling::cleanupPyramid() {
+    if (_pyramid == VK_NULL_HANDLE)
+        return;
+
+    for (auto view : _pyramidLevelViews) {
+        vkDestroyImageView(_device, view, nullptr);
+    }
+    _pyramidLevelViews.clear();
+    vkDestroyImageView(_device, _pyramidView, nullptr);
+    vkDestroyImage(_device, _pyramid, nullptr);
+    _allocator->free(_pyramidMemory);
+    _pyramid = VK_NULL_HANDLE;
+}
+
+void AppCulling::writeDescriptorSets(VkBuffer uniformBuffer, VkDeviceSize uniformRange, VkBuffer instanceBuffer, VkDeviceSize instanceRange) {
+    if (!Enabled)
+        return;
+
+    // ranges cover one target image's region, the dynamic offsets pick the image
+    std::array<VkDescriptorBufferInfo, 4> bufferInfos = {};
+    bufferInfos[0] = {uniformBuffer, 0, uniformRange};
+    bufferInfos[1] = {instanceBuffer, 0, instanceRange};
+    bufferInfos[2] = {_drawBuffer, 0, sizeof(VkDrawIndexedIndirectCommand) * _capacity};
+    bufferInfos[3] = {_counterBuffer, 0, sizeof(CullStats)};
+
+    std::array<VkWriteDescriptorSet, 4> writes = {};
+    for (uint32_t i = 0; i < writes.size(); i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = _cullSet;
+        writes[i].dstBinding = i;
+        writes[i].dstArrayElement = 0;
+        writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+bool AppCulling::compact(uint32_t objectCount) {
+    // a count above the device limit can't go through a single counted draw
+    return DrawCount && objectCount <= _properties.limits.maxDrawIndirectCount;
+}
+
+void AppCulling::recordCull(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t uniformOffset, uint32_t instanceOffset, uint32_t objectCount) {
+    vkCmdFillBuffer(commandBuffer, _counterBuffer, _counterRegionSize * frame, sizeof(CullStats), 0);
+
+    // the cleared counters, and the pyramid the previous submission built
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        1, &barrier, 0, nullptr, 0, nullptr);
+
+    CullPushConstants constants = {};
+    constants.Sphere = _sphere;
+    constants.PyramidSize = glm::vec2(_pyramidExtent.width, _pyramidExtent.height);
+    constants.ObjectCount = objectCount;
+    constants.IndexCount = _indexCount;
+    constants.PyramidLevels = static_cast<uint32_t>(_pyramidLevelViews.size());
+    constants.Occlusion = Occlusion ? 1 : 0;
+    constants.Compact = compact(objectCount) ? 1 : 0;
+
+    uint32_t dynamicOffsets[] = {uniformOffset, instanceOffset, static_cast<uint32_t>(_drawRegionSize * frame), static_cast<uint32_t>(_counterRegionSize * frame)};
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipelineLayout, 0, 1, &_cullSet, 4, dynamicOffsets);
+    vkCmdPushConstants(commandBuffer, _cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(commandBuffer, groupCount(std::max(objectCount, 1u), 64), 1, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+        1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void AppCulling::recordDraw(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t objectCount, uint32_t first, uint32_t count) {
+    auto stride = static_cast<uint32_t>(sizeof(VkDrawIndexedIndirectCommand));
+    if (compact(objectCount)) {
+        // compacted commands don't map to objects, the whole list goes out in one call
+        _vkCmdDrawIndexedIndirectCount(commandBuffer, _drawBuffer, _drawRegionSize * frame, _counterBuffer, _counterRegionSize * frame, objectCount, stride);
+        return;
+    }
+
+    // culled objects are still walked by the command processor, with an instance count of 0
+    auto maxDraws = std::max(_properties.limits.maxDrawIndirectCount, 1u);
+    auto end = first + count;
+    for (; first < end; first += maxDraws) {
+        auto draws = std::min(end - first, maxDraws);
+        vkCmdDrawIndexedIndirect(commandBuffer, _drawBuffer, _drawRegionSize * frame + first * stride, draws, stride);
+    }
+}
+
+void AppCulling::recordPyramid(VkCommandBuffer commandBuffer) {
+    if (!Occlusion)
+        return;
+
+    // the render pass made the depth writes visible to compute, this covers the cull pass still reading the pyramid
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        1, &barrier, 0, nullptr, 0, nullptr);
+
+    HiZPushConstants constants = {};
+    constants.SrcSize[0] = _depthExtent.width;
+    constants.SrcSize[1] = _depthExtent.height;
+    constants.DstSize[0] = _pyramidExtent.width;
+    constants.DstSize[1] = _pyramidExtent.height;
+    constants.Samples = static_cast<uint32_t>(_samples);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _initPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _initPipelineLayout, 0, 1, &_initSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, _initPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(commandBuffer, groupCount(constants.DstSize[0], 8), groupCount(constants.DstSize[1], 8), 1);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _reducePipeline);
+    for (uint32_t i = 1; i < _pyramidLevelViews.size(); i++) {
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            1, &barrier, 0, nullptr, 0, nullptr);
+
+        constants.SrcSize[0] = constants.DstSize[0];
+        constants.SrcSize[1] = constants.DstSize[1];
+        constants.DstSize[0] = std::max(constants.DstSize[0] / 2, 1u);
+        constants.DstSize[1] = std::max(constants.DstSize[1] / 2, 1u);
+        constants.Samples = 1;
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _reducePipelineLayout, 0, 1, &_reduceSets[i], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, _reducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(commandBuffer, groupCount(constants.DstSize[0], 8), groupCount(constants.DstSize[1], 8), 1);
+    }
+}
+
+void AppCulling::recordStats(VkCommandBuffer commandBuffer, uint32_t frame) {
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        1, &barrier, 0, nullptr, 0, nullptr);
+
+    VkBufferCopy region = {};
+    region.srcOffset = _counterRegionSize * frame;
+    region.dstOffset = sizeof(CullStats) * frame;
+    region.size = sizeof(CullStats);
+    vkCmdCopyBuffer(commandBuffer, _counterBuffer, _statsBuffer, 1, &region);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+        1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+CullStats AppCulling::getStats(uint32_t frame) {
+    CullStats stats = {};
+    if (Enabled) {
+        memcpy(&stats, static_cast<char*>(_statsBufferMemory.Mapped) + sizeof(CullStats) * frame, sizeof(CullStats));
+    }
+    return stats;
+}
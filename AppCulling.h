@@ -0,0 +1,141 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "AppAllocator.h"
+#include "AppDevice.h"
+#include "Vertex.h"
+
+#include <array>
+#include <string>
+#include <vector>
+
+// Counters written by the cull pass, one set per target image.
+// Objects is 0 until a frame has used the slot.
+struct CullStats {
+    uint32_t Visible;
+    uint32_t FrustumCulled;
+    uint32_t OcclusionCulled;
+    uint32_t Objects;
+};
+
+// matches the push constant block of cull.comp
+struct CullPushConstants {
+    glm::vec4 Sphere;
+    glm::vec2 PyramidSize;
+    uint32_t ObjectCount;
+    uint32_t IndexCount;
+    uint32_t PyramidLevels;
+    uint32_t Occlusion;
+    uint32_t Compact;
+};
+
+static_assert(sizeof(CullPushConstants) == 44, "CullPushConstants must match the push constants in cull.comp");
+
+// matches the push constant block of hiz_init.comp and hiz_reduce.comp
+struct HiZPushConstants {
+    uint32_t SrcSize[2];
+    uint32_t DstSize[2];
+    uint32_t Samples;
+};
+
+// GPU-driven culling. A compute pass tests every object's bounding sphere
+// against the frustum and against a max-depth pyramid built from the previous
+// frame's depth attachment, and writes a VkDrawIndexedIndirectCommand for each
+// object that survives. With VK_KHR_draw_indirect_count the commands are
+// compacted and drawn with a GPU-written count, otherwise there is one command
+// per object and culled ones get an instance count of 0.
+//
+// Objects are the instances of the mesh: object i is drawn with firstInstance i,
+// so the vertex shader still finds its transform through gl_InstanceIndex.
+class AppCulling {
+public:
+    // false before init() keeps the plain instanced draw, init() clears it when the device can't cull
+    bool Enabled = true;
+    // Hi-Z test on top of the frustum test, needs a sampleable depth format
+    bool Occlusion = true;
+    // compacted commands and a GPU-written count instead of one command per object
+    bool DrawCount = false;
+
+    static const uint32_t MaxPyramidLevels = 16;
+
+    void init(AppDevice* device, AppAllocator* allocator, VkPipelineCache pipelineCache, VkFormat depthFormat);
+    void cleanup();
+
+    // the depth attachment has to be stored and sampled for the pyramid
+    bool readsDepth() const { return Enabled && Occlusion; }
+
+    // bounding sphere of the mesh every object draws
+    void setMesh(const Vertex* vertices, size_t vertexCount, size_t indexCount);
+
+    // draw and counter regions for capacity objects per target image
+    void createBuffers(uint32_t capacity, uint32_t frames);
+    void cleanupBuffers();
+    // pyramid over the depth attachment, a 1x1 pyramid that never occludes without occlusion
+    void createPyramid(VkCommandBuffer commandBuffer, VkImageView depthView, VkExtent2D extent);
+    void cleanupPyramid();
+    void writeDescriptorSets(VkBuffer uniformBuffer, VkDeviceSize uniformRange, VkBuffer instanceBuffer, VkDeviceSize instanceRange);
+
+    // before the render pass
+    void recordCull(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t uniformOffset, uint32_t instanceOffset, uint32_t objectCount);
+    // false when the draws go through a single counted draw that has to be recorded whole
+    bool splitsDraws(uint32_t objectCount) { return !compact(objectCount); }
+    // inside the render pass, with the graphics pipeline and its buffers bound: objects [first, first + count)
+    void recordDraw(VkCommandBuffer commandBuffer, uint32_t frame, uint32_t objectCount, uint32_t first, uint32_t count);
+    // after the render pass
+    void recordPyramid(VkCommandBuffer commandBuffer);
+    void recordStats(VkCommandBuffer commandBuffer, uint32_t frame);
+
+    // valid once the fence of the frame's last submission has signalled
+    CullStats getStats(uint32_t frame);
+
+private:
+    void createDescriptorSetLayouts();
+    void createPipelines(VkPipelineCache pipelineCache);
+    void createDescriptorSets();
+    void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, AppAllocation& memory);
+    bool compact(uint32_t objectCount);
+
+    VkDevice _device;
+    AppAllocator* _allocator;
+    VkPhysicalDeviceProperties _properties;
+    VkSampleCountFlagBits _samples;
+    PFN_vkCmdDrawIndexedIndirectCountKHR _vkCmdDrawIndexedIndirectCount = nullptr;
+
+    glm::vec4 _sphere = glm::vec4(0.0f);
+    uint32_t _indexCount = 0;
+
+    VkDescriptorSetLayout _cullSetLayout;
+    VkDescriptorSetLayout _initSetLayout;
+    VkDescriptorSetLayout _reduceSetLayout;
+    VkPipelineLayout _cullPipelineLayout;
+    VkPipelineLayout _initPipelineLayout;
+    VkPipelineLayout _reducePipelineLayout;
+    VkPipeline _cullPipeline;
+    VkPipeline _initPipeline;
+    VkPipeline _reducePipeline;
+
+    VkDescriptorPool _descriptorPool;
+    VkDescriptorSet _cullSet;
+    VkDescriptorSet _initSet;
+    std::array<VkDescriptorSet, MaxPyramidLevels> _reduceSets;
+    VkSampler _sampler;
+
+    // per target image regions, bound with dynamic offsets like the uniform ring
+    VkBuffer _drawBuffer = VK_NULL_HANDLE;
+    AppAllocation _drawBufferMemory;
+    VkDeviceSize _drawRegionSize;
+    VkBuffer _counterBuffer = VK_NULL_HANDLE;
+    AppAllocation _counterBufferMemory;
+    VkDeviceSize _counterRegionSize;
+    VkBuffer _statsBuffer = VK_NULL_HANDLE;
+    AppAllocation _statsBufferMemory;
+    uint32_t _capacity = 0;
+
+    VkImage _pyramid = VK_NULL_HANDLE;
+    AppAllocation _pyramidMemory;
+    VkImageView _pyramidView;
+    std::vector<VkImageView> _pyramidLevelViews;
+    VkExtent2D _pyramidExtent;
+    VkExtent2D _depthExtent;
+};
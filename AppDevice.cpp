@@ -1,8 +1,11 @@
 #include "AppDevice.h"
 
+#include <cstring>
+
 void AppDevice::init(AppInstance* instance, GLFWwindow* window, const std::vector<const char*>& extensions) {
     Instance = instance;
     Window = window;
+    Headless = window == nullptr;
 
     _deviceExtensions = extensions;
     initDevice();
@@ -10,7 +13,9 @@ void AppDevice::init(AppInstance* instance, GLFWwindow* window, const std::vecto
 
 void AppDevice::cleanup() {
     vkDestroyDevice(Device, nullptr);
-    vkDestroySurfaceKHR(Instance->Instance, Surface, nullptr);
+    if (!Headless) {
+        vkDestroySurfaceKHR(Instance->Instance, Surface, nullptr);
+    }
 }
 
 SwapChainSupportDetails AppDevice::getSwapChainSupportDetails() {
@@ -18,7 +23,10 @@ SwapChainSupportDetails AppDevice::getSwapChainSupportDetails() {
 }
 
 void AppDevice::initDevice() {
-    createSurface();
+    Surface = VK_NULL_HANDLE;
+    if (!Headless) {
+        createSurface();
+    }
     pickPhysicalDevice();
     createLogicalDevice();
 }
@@ -51,7 +59,13 @@ void AppDevice::createLogicalDevice() {
     auto indices = findQueueFamilies(PhysicalDevice);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<int> uniqueQueueFamilies = {indices.graphicsFamily, indices.presentFamily};
+    std::set<int> uniqueQueueFamilies = {indices.graphicsFamily};
+    if (!Headless) {
+        uniqueQueueFamilies.insert(indices.presentFamily);
+    }
+    if (indices.transferFamily >= 0) {
+        uniqueQueueFamilies.insert(indices.transferFamily);
+    }
     
     float queuePriority = 1.0f;
     for (int queueFamily : uniqueQueueFamilies) {
@@ -63,17 +77,33 @@ void AppDevice::createLogicalDevice() {
         queueCreateInfos.push_back(queueCreateInfo);
     }
     
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(PhysicalDevice, &supportedFeatures);
+    MultiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+    DrawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+    TextureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
+
     VkPhysicalDeviceFeatures deviceFeatures = {};
     deviceFeatures.samplerAnisotropy = VK_TRUE;
     deviceFeatures.sampleRateShading = VK_TRUE;
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+
+    // the GPU written draw count is an extension on a 1.0 instance
+    auto enabledExtensions = _deviceExtensions;
+    DrawIndirectCount = hasDeviceExtension(PhysicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (DrawIndirectCount) {
+        enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
     
     VkDeviceCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(_deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = _deviceExtensions.data();
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
     createInfo.enabledLayerCount = 0;
 
     if (Instance->ValidationLayers) {
@@ -87,7 +117,14 @@ void AppDevice::createLogicalDevice() {
     }
     
     vkGetDeviceQueue(Device, indices.graphicsFamily, 0, &GraphicsQueue);
-    vkGetDeviceQueue(Device, indices.presentFamily, 0, &PresentQueue);
+    PresentQueue = VK_NULL_HANDLE;
+    if (!Headless) {
+        vkGetDeviceQueue(Device, indices.presentFamily, 0, &PresentQueue);
+    }
+    TransferQueue = VK_NULL_HANDLE;
+    if (indices.transferFamily >= 0) {
+        vkGetDeviceQueue(Device, indices.transferFamily, 0, &TransferQueue);
+    }
 }
 
 QueueFamilyIndices AppDevice::findQueueFamilies(VkPhysicalDevice device) {
@@ -102,7 +139,9 @@ QueueFamilyIndices AppDevice::findQueueFamilies(VkPhysicalDevice device) {
     int i = 0;
     for (const auto& queueFamily : queueFamilies) {
         VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, Surface, &presentSupport);
+        if (!Headless) {
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, Surface, &presentSupport);
+        }
         if (queueFamily.queueCount > 0 && presentSupport) {
             indices.presentFamily = i; 
         }
@@ -110,13 +149,22 @@ QueueFamilyIndices AppDevice::findQueueFamilies(VkPhysicalDevice device) {
             indices.graphicsFamily = i;
         }
 
-        if (indices.isComplete()) {
+        if (indices.isComplete(!Headless)) {
             break;
         }
 
         i++;
     }
 
+    // whole mip levels are all that is ever copied, which any transfer granularity allows
+    for (i = 0; i < static_cast<int>(queueFamilies.size()); i++) {
+        auto flags = queueFamilies[i].queueFlags;
+        if (queueFamilies[i].queueCount > 0 && (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            indices.transferFamily = i;
+            break;
+        }
+    }
+
     return indices;
 }
 
@@ -144,6 +192,20 @@ VkSampleCountFlagBits AppDevice::getMaxUsableSampleCount() {
     return VK_SAMPLE_COUNT_1_BIT;
 }
 
+bool AppDevice::hasDeviceExtension(VkPhysicalDevice device, const char* name) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+    for (const auto& extension : availableExtensions) {
+        if (strcmp(extension.extensionName, name) == 0)
+            return true;
+    }
+    return false;
+}
+
 bool AppDevice::checkDeviceExtensionSupport(VkPhysicalDevice device) {
     uint32_t extensionCount;
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
@@ -165,8 +227,9 @@ bool AppDevice::isDeviceSuitable(VkPhysicalDevice device) {
 
     bool extensionsSupported = checkDeviceExtensionSupport(device);
 
-    bool swapChainAdequate = false;
-    if (extensionsSupported) {
+    // offscreen targets stand in for the swapchain when headless
+    bool swapChainAdequate = Headless;
+    if (extensionsSupported && !Headless) {
         auto swapChainSupport = querySwapChainSupport(device);
         swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
@@ -174,7 +237,7 @@ bool AppDevice::isDeviceSuitable(VkPhysicalDevice device) {
     VkPhysicalDeviceFeatures supportedFeatures;
     vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+    return indices.isComplete(!Headless) && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
 }
 
 SwapChainSupportDetails AppDevice::querySwapChainSupport(VkPhysicalDevice device) {
@@ -15,9 +15,12 @@
 struct QueueFamilyIndices {
     int graphicsFamily = -1;
     int presentFamily = -1;
+    // optional family with transfer but neither graphics nor compute, usually a dedicated copy engine
+    int transferFamily = -1;
 
-    bool isComplete() {
-        return graphicsFamily >= 0 && presentFamily >= 0;
+    // headless devices never present, so they only need a graphics family
+    bool isComplete(bool needsPresent = true) {
+        return graphicsFamily >= 0 && (!needsPresent || presentFamily >= 0);
     }
 };
 
@@ -83,12 +86,25 @@ public:
     VkSurfaceKHR Surface;
     VkQueue GraphicsQueue;
     VkQueue PresentQueue;
+    // VK_NULL_HANDLE without a dedicated transfer family, uploads then go through GraphicsQueue
+    VkQueue TransferQueue;
 
     VkSampleCountFlagBits DeviceMsaaSamples = VK_SAMPLE_COUNT_1_BIT;
     QueueFamilyIndices DeviceQueueFamilyIndices;
 
     bool FramebufferResized;
 
+    // true when init() was given no window: no surface, no present queue
+    bool Headless = false;
+
+    // optional features GPU culling needs, enabled whenever the device has them
+    bool MultiDrawIndirect = false;
+    bool DrawIndirectFirstInstance = false;
+    // VK_KHR_draw_indirect_count
+    bool DrawIndirectCount = false;
+    // BC1-BC7 textures, otherwise the texture is decoded from the JPEG at startup
+    bool TextureCompressionBC = false;
+
     void init(AppInstance* instance, GLFWwindow* window, const std::vector<const char*>& extensions);
     void cleanup();
 
@@ -105,6 +121,7 @@ private:
 
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool hasDeviceExtension(VkPhysicalDevice device, const char* name);
     bool isDeviceSuitable(VkPhysicalDevice device);
 
     VkSampleCountFlagBits getMaxUsableSampleCount();
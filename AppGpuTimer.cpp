@@ -0,0 +1,123 @@
+#include "AppGpuTimer.h"
+
+#include <iostream>
+#include <stdexcept>
+
+using std::cout;
+using std::endl;
+
+namespace {
+    VkQueryPool createPool(VkDevice device, uint32_t count) {
+        VkQueryPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        poolInfo.queryCount = count;
+
+        VkQueryPool pool;
+        if (vkCreateQueryPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+        return pool;
+    }
+}
+
+void AppGpuTimer::init(AppDevice* device) {
+    _device = device->Device;
+    if (!Enabled)
+        return;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device->PhysicalDevice, &properties);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device->PhysicalDevice, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device->PhysicalDevice, &familyCount, families.data());
+
+    auto validBits = families[device->DeviceQueueFamilyIndices.graphicsFamily].timestampValidBits;
+    if (validBits == 0 || properties.limits.timestampPeriod <= 0.0f) {
+        cout << "profile: the graphics queue has no timestamps, GPU times are left out" << endl;
+        Enabled = false;
+        return;
+    }
+
+    _period = properties.limits.timestampPeriod;
+    _mask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+    _calibrationPool = createPool(_device, 1);
+}
+
+void AppGpuTimer::cleanup() {
+    if (!Enabled)
+        return;
+
+    vkDestroyQueryPool(_device, _queryPool, nullptr);
+    _queryPool = VK_NULL_HANDLE;
+    vkDestroyQueryPool(_device, _calibrationPool, nullptr);
+    _calibrationPool = VK_NULL_HANDLE;
+}
+
+void AppGpuTimer::createQueries(uint32_t slots) {
+    if (!Enabled)
+        return;
+
+    // the caller has waited for the device, nothing in the old pool is still pending
+    vkDestroyQueryPool(_device, _queryPool, nullptr);
+    _queryPool = createPool(_device, slots * GpuTimestampCount);
+    _pending.assign(slots, false);
+}
+
+void AppGpuTimer::recordCalibration(VkCommandBuffer commandBuffer) {
+    if (!Enabled)
+        return;
+
+    vkCmdResetQueryPool(commandBuffer, _calibrationPool, 0, 1);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _calibrationPool, 0);
+}
+
+void AppGpuTimer::calibrate(uint64_t cpuNanoseconds) {
+    if (!Enabled)
+        return;
+
+    uint64_t ticks = 0;
+    if (vkGetQueryPoolResults(_device, _calibrationPool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+        throw std::runtime_error("failed to read calibration timestamp!");
+    }
+
+    // the CPU reading comes a submit-and-wait later than the GPU one, so GPU work shows up slightly late rather than early
+    auto gpuNanoseconds = static_cast<int64_t>((ticks & _mask) * _period);
+    _offset = static_cast<int64_t>(cpuNanoseconds) - gpuNanoseconds;
+}
+
+void AppGpuTimer::begin(VkCommandBuffer commandBuffer, uint32_t slot) {
+    if (!Enabled)
+        return;
+
+    vkCmdResetQueryPool(commandBuffer, _queryPool, slot * GpuTimestampCount, GpuTimestampCount);
+    // top of pipe: the frame starts when the GPU gets to it, not when earlier work drains
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _queryPool, slot * GpuTimestampCount + GpuFrameBegin);
+    _pending[slot] = true;
+}
+
+void AppGpuTimer::write(VkCommandBuffer commandBuffer, uint32_t slot, GpuTimestamp timestamp) {
+    if (!Enabled)
+        return;
+
+    // bottom of pipe waits for everything recorded before it, so each mark closes the previous span
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, _queryPool, slot * GpuTimestampCount + timestamp);
+}
+
+bool AppGpuTimer::resolve(uint32_t slot, uint64_t nanoseconds[GpuTimestampCount]) {
+    if (!Enabled || slot >= _pending.size() || !_pending[slot])
+        return false;
+
+    uint64_t ticks[GpuTimestampCount];
+    auto result = vkGetQueryPoolResults(_device, _queryPool, slot * GpuTimestampCount, GpuTimestampCount, sizeof(ticks), ticks, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS)
+        return false;
+    _pending[slot] = false;
+
+    for (uint32_t i = 0; i < GpuTimestampCount; i++) {
+        nanoseconds[i] = static_cast<uint64_t>(static_cast<int64_t>((ticks[i] & _mask) * _period) + _offset);
+    }
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "AppDevice.h"
+
+#include <cstdint>
+#include <vector>
+
+// points in a frame's command buffer that get a timestamp
+enum GpuTimestamp {
+    GpuFrameBegin,
+    GpuRenderPassBegin,
+    GpuRenderPassEnd,
+    GpuReadbackBegin,
+    GpuReadbackEnd,
+    GpuTimestampCount
+};
+
+// Timestamp queries in a ring with one slot per target image. A slot is
+// reset and written by the frame's own command buffer and read back, without
+// waiting, once the fence of that submission has signalled, i.e. right before
+// the slot is recorded again.
+//
+// GPU ticks are turned into nanoseconds and shifted onto the CPU clock passed
+// to calibrate(), so both sides line up in one trace.
+class AppGpuTimer {
+public:
+    // set before init(); turned off when the graphics queue has no timestamps
+    bool Enabled = false;
+
+    void init(AppDevice* device);
+    void cleanup();
+
+    // one slot per target image, recreated with the command buffers
+    void createQueries(uint32_t slots);
+
+    // a single timestamp submitted through commandBuffer, which the caller
+    // submits and waits for, then calibrate() with the CPU time right after
+    void recordCalibration(VkCommandBuffer commandBuffer);
+    void calibrate(uint64_t cpuNanoseconds);
+
+    // at the start of the slot's command buffer, outside any render pass: resets the slot and writes GpuFrameBegin
+    void begin(VkCommandBuffer commandBuffer, uint32_t slot);
+    void write(VkCommandBuffer commandBuffer, uint32_t slot, GpuTimestamp timestamp);
+
+    // false when the slot holds nothing new or the results aren't available yet
+    bool resolve(uint32_t slot, uint64_t nanoseconds[GpuTimestampCount]);
+
+private:
+    VkDevice _device;
+    VkQueryPool _queryPool = VK_NULL_HANDLE;
+    VkQueryPool _calibrationPool = VK_NULL_HANDLE;
+    std::vector<bool> _pending;
+
+    double _period = 1.0;
+    uint64_t _mask = ~0ull;
+    int64_t _offset = 0;
+};
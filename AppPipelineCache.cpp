@@ -0,0 +1,106 @@
+#include "AppPipelineCache.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    const uint32_t cacheMagic = 0x43505456; // "VTPC"
+    const uint32_t cacheFormatVersion = 1;
+
+    // prepended to the driver's blob so stale files are rejected before the driver sees them
+    struct CacheFileHeader {
+        uint32_t Magic;
+        uint32_t FormatVersion;
+        uint32_t VendorID;
+        uint32_t DeviceID;
+        uint32_t DriverVersion;
+        uint8_t PipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t DataSize;
+    };
+}
+
+void AppPipelineCache::init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path) {
+    _device = device;
+    _path = path;
+    vkGetPhysicalDeviceProperties(physicalDevice, &_properties);
+
+    std::string data;
+    Loaded = load(data);
+
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = Loaded ? data.size() : 0;
+    createInfo.pInitialData = Loaded ? data.data() : nullptr;
+
+    if (vkCreatePipelineCache(_device, &createInfo, nullptr, &Cache) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create pipeline cache!");
+    }
+}
+
+void AppPipelineCache::cleanup() {
+    save();
+    vkDestroyPipelineCache(_device, Cache, nullptr);
+}
+
+bool AppPipelineCache::load(std::string& data) {
+    std::ifstream file(_path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    CacheFileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+
+    bool valid = header.Magic == cacheMagic &&
+        header.FormatVersion == cacheFormatVersion &&
+        header.VendorID == _properties.vendorID &&
+        header.DeviceID == _properties.deviceID &&
+        header.DriverVersion == _properties.driverVersion &&
+        memcmp(header.PipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    if (!valid) {
+        std::cout << "pipeline cache " << _path << " was written by another device or driver, ignoring it" << std::endl;
+        return false;
+    }
+
+    // a torn or corrupt file can claim any size, only trust what is actually there
+    auto dataStart = file.tellg();
+    file.seekg(0, std::ios::end);
+    auto available = static_cast<uint64_t>(file.tellg() - dataStart);
+    if (header.DataSize == 0 || header.DataSize > available) {
+        std::cout << "pipeline cache " << _path << " is truncated, ignoring it" << std::endl;
+        return false;
+    }
+    file.seekg(dataStart);
+
+    data.resize(static_cast<size_t>(header.DataSize));
+    return static_cast<bool>(file.read(&data[0], data.size()));
+}
+
+void AppPipelineCache::save() {
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(_device, Cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0) {
+        return;
+    }
+
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(_device, Cache, &dataSize, data.data()) != VK_SUCCESS) {
+        return;
+    }
+
+    CacheFileHeader header = {};
+    header.Magic = cacheMagic;
+    header.FormatVersion = cacheFormatVersion;
+    header.VendorID = _properties.vendorID;
+    header.DeviceID = _properties.deviceID;
+    header.DriverVersion = _properties.driverVersion;
+    memcpy(header.PipelineCacheUUID, _properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.DataSize = dataSize;
+
+    writeFileAtomic(_path, {{0, &header, sizeof(header)}, {sizeof(header), data.data(), dataSize}});
+}
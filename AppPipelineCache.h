@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+
+// VkPipelineCache persisted between runs. The file is only reused when it was
+// written by the same device and driver, otherwise the cache starts empty.
+class AppPipelineCache {
+public:
+    VkPipelineCache Cache = VK_NULL_HANDLE;
+
+    // true when init() found a usable file on disk
+    bool Loaded = false;
+
+    void init(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+    // writes the cache back to disk before destroying it
+    void cleanup();
+
+private:
+    bool load(std::string& data);
+    void save();
+
+    VkDevice _device;
+    VkPhysicalDeviceProperties _properties;
+    std::string _path;
+};
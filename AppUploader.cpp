@@ -0,0 +1,271 @@
+#include "AppUploader.h"
+
+#include <array>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    // covers the texel block size of every format and the 4 byte rule for buffer copies
+    const VkDeviceSize stagingAlignment = 16;
+
+    VkCommandPool createPool(VkDevice device, uint32_t queueFamily) {
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = queueFamily;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        VkCommandPool pool;
+        if (vkCreateCommandPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS) {
+            throw std::runtime_error("failed to create upload command pool!");
+        }
+        return pool;
+    }
+
+    VkCommandBuffer allocateCommandBuffer(VkDevice device, VkCommandPool pool) {
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandPool = pool;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw std::runtime_error("failed to allocate upload command buffer!");
+        }
+        return commandBuffer;
+    }
+}
+
+void AppUploader::init(AppDevice* device, AppAllocator* allocator, VkDeviceSize stagingSize) {
+    _device = device->Device;
+    _allocator = allocator;
+    _graphicsQueue = device->GraphicsQueue;
+    _graphicsFamily = static_cast<uint32_t>(device->DeviceQueueFamilyIndices.graphicsFamily);
+    _transferQueue = _graphicsQueue;
+    _transferFamily = _graphicsFamily;
+    if (device->TransferQueue != VK_NULL_HANDLE) {
+        _transferQueue = device->TransferQueue;
+        _transferFamily = static_cast<uint32_t>(device->DeviceQueueFamilyIndices.transferFamily);
+    }
+
+    _transferPool = createPool(_device, _transferFamily);
+    _graphicsPool = createPool(_device, _graphicsFamily);
+    _transferCommands = allocateCommandBuffer(_device, _transferPool);
+    _graphicsCommands = allocateCommandBuffer(_device, _graphicsPool);
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if (vkCreateSemaphore(_device, &semaphoreInfo, nullptr, &_transferDone) != VK_SUCCESS ||
+        vkCreateFence(_device, &fenceInfo, nullptr, &_batchDone) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create upload synchronization objects!");
+    }
+
+    createStaging(stagingSize);
+}
+
+void AppUploader::cleanup() {
+    flush();
+
+    vkDestroyBuffer(_device, _stagingBuffer, nullptr);
+    _allocator->free(_stagingMemory);
+    vkDestroyFence(_device, _batchDone, nullptr);
+    vkDestroySemaphore(_device, _transferDone, nullptr);
+    vkDestroyCommandPool(_device, _graphicsPool, nullptr);
+    vkDestroyCommandPool(_device, _transferPool, nullptr);
+}
+
+void AppUploader::createStaging(VkDeviceSize size) {
+    if (_stagingBuffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(_device, _stagingBuffer, nullptr);
+        _allocator->free(_stagingMemory);
+    }
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(_device, &bufferInfo, nullptr, &_stagingBuffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create staging buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(_device, _stagingBuffer, &memRequirements);
+    // the ring lives as long as the uploader, so it is not a linear pool candidate
+    _stagingMemory = _allocator->allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 0, true, AppAllocationStrategy::Buddy);
+    vkBindBufferMemory(_device, _stagingBuffer, _stagingMemory.Memory, _stagingMemory.Offset);
+
+    _stagingSize = size;
+    _stagingHead = 0;
+}
+
+void AppUploader::begin() {
+    if (_recording)
+        return;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(_transferCommands, &beginInfo);
+    vkBeginCommandBuffer(_graphicsCommands, &beginInfo);
+    _recording = true;
+}
+
+VkDeviceSize AppUploader::allocateStaging(VkDeviceSize size) {
+    auto offset = (_stagingHead + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+    if (offset + size > _stagingSize) {
+        // out of room: send what is queued and start over at the front of the ring
+        flush();
+        offset = 0;
+        if (size > _stagingSize) {
+            auto grown = _stagingSize;
+            while (grown < size) {
+                grown *= 2;
+            }
+            createStaging(grown);
+        }
+    }
+
+    begin();
+    _stagingHead = offset + size;
+    _stats.Uploads++;
+    _stats.Bytes += size;
+    return offset;
+}
+
+void AppUploader::transferOwnership(const VkBufferMemoryBarrier* bufferBarrier, const VkImageMemoryBarrier* imageBarrier, VkPipelineStageFlags dstStage) {
+    if (!dedicatedTransfer()) {
+        // one queue family: a plain barrier, recorded after the copy in the same submission
+        vkCmdPipelineBarrier(_transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+            0, nullptr, bufferBarrier ? 1 : 0, bufferBarrier, imageBarrier ? 1 : 0, imageBarrier);
+        return;
+    }
+
+    // release on the transfer queue, then acquire on the graphics queue with the same
+    // families and layouts; the access masks that don't apply on each side are dropped
+    if (bufferBarrier) {
+        auto release = *bufferBarrier;
+        release.dstAccessMask = 0;
+        vkCmdPipelineBarrier(_transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+        auto acquire = *bufferBarrier;
+        acquire.srcAccessMask = 0;
+        vkCmdPipelineBarrier(_graphicsCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0, 0, nullptr, 1, &acquire, 0, nullptr);
+    }
+    if (imageBarrier) {
+        auto release = *imageBarrier;
+        release.dstAccessMask = 0;
+        vkCmdPipelineBarrier(_transferCommands, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &release);
+        auto acquire = *imageBarrier;
+        acquire.srcAccessMask = 0;
+        vkCmdPipelineBarrier(_graphicsCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStage, 0, 0, nullptr, 0, nullptr, 1, &acquire);
+    }
+}
+
+void* AppUploader::stageBuffer(VkBuffer dst, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    auto offset = allocateStaging(size);
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = offset;
+    copyRegion.dstOffset = 0;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(_transferCommands, _stagingBuffer, dst, 1, &copyRegion);
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = dedicatedTransfer() ? _transferFamily : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = dedicatedTransfer() ? _graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = dst;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    transferOwnership(&barrier, nullptr, dstStage);
+
+    return static_cast<char*>(_stagingMemory.Mapped) + offset;
+}
+
+void* AppUploader::stageImage(VkImage image, VkDeviceSize size, const VkBufferImageCopy* regions, uint32_t regionCount, uint32_t mipLevels,
+    VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    auto offset = allocateStaging(size);
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+    vkCmdPipelineBarrier(_transferCommands, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    std::vector<VkBufferImageCopy> stagedRegions(regions, regions + regionCount);
+    for (auto& region : stagedRegions) {
+        region.bufferOffset += offset;
+    }
+    vkCmdCopyBufferToImage(_transferCommands, _stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regionCount, stagedRegions.data());
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = finalLayout;
+    barrier.srcQueueFamilyIndex = dedicatedTransfer() ? _transferFamily : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = dedicatedTransfer() ? _graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+    transferOwnership(nullptr, &barrier, dstStage);
+
+    return static_cast<char*>(_stagingMemory.Mapped) + offset;
+}
+
+VkCommandBuffer AppUploader::graphicsCommands() {
+    begin();
+    return _graphicsCommands;
+}
+
+void AppUploader::flush() {
+    if (!_recording)
+        return;
+
+    vkEndCommandBuffer(_transferCommands);
+    vkEndCommandBuffer(_graphicsCommands);
+    _recording = false;
+
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    std::array<VkSubmitInfo, 2> submits = {};
+    submits[0].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submits[0].commandBufferCount = 1;
+    submits[0].pCommandBuffers = &_transferCommands;
+    submits[1].sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submits[1].commandBufferCount = 1;
+    submits[1].pCommandBuffers = &_graphicsCommands;
+
+    if (dedicatedTransfer()) {
+        submits[0].signalSemaphoreCount = 1;
+        submits[0].pSignalSemaphores = &_transferDone;
+        submits[1].waitSemaphoreCount = 1;
+        submits[1].pWaitSemaphores = &_transferDone;
+        submits[1].pWaitDstStageMask = &waitStage;
+        if (vkQueueSubmit(_transferQueue, 1, &submits[0], VK_NULL_HANDLE) != VK_SUCCESS ||
+            vkQueueSubmit(_graphicsQueue, 1, &submits[1], _batchDone) != VK_SUCCESS) {
+            throw std::runtime_error("failed to submit uploads!");
+        }
+    } else if (vkQueueSubmit(_graphicsQueue, static_cast<uint32_t>(submits.size()), submits.data(), _batchDone) != VK_SUCCESS) {
+        throw std::runtime_error("failed to submit uploads!");
+    }
+
+    // one wait per batch, not per copy
+    auto startTime = std::chrono::high_resolution_clock::now();
+    vkWaitForFences(_device, 1, &_batchDone, VK_TRUE, UINT64_MAX);
+    _stats.WaitSeconds += std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+    vkResetFences(_device, 1, &_batchDone);
+    _stats.Batches++;
+
+    vkResetCommandPool(_device, _transferPool, 0);
+    vkResetCommandPool(_device, _graphicsPool, 0);
+    _stagingHead = 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "AppAllocator.h"
+#include "AppDevice.h"
+
+struct AppUploaderStats {
+    // submissions, each one GPU round trip however many uploads it carried
+    uint32_t Batches;
+    uint32_t Uploads;
+    VkDeviceSize Bytes;
+    double WaitSeconds;
+};
+
+// Batches uploads through a persistent host-visible staging ring.
+//
+// Copies are recorded on the dedicated transfer queue when AppDevice found
+// one, and handed to the graphics queue with queue family ownership transfer
+// barriers. Commands that have to run on the graphics queue once the data is
+// there (mipmap blits, clears) go into graphicsCommands(). Everything staged
+// since the last flush() goes out in one submission whose completion is
+// tracked by a fence. The ring is only flushed early when it runs out of space.
+class AppUploader {
+public:
+    void init(AppDevice* device, AppAllocator* allocator, VkDeviceSize stagingSize = 64 * 1024 * 1024);
+    void cleanup();
+
+    // true when copies go through a transfer-only queue family
+    bool dedicatedTransfer() const { return _transferFamily != _graphicsFamily; }
+
+    // Returns where to write size bytes for dst, copied at the next flush and made
+    // visible to dstStage/dstAccess on the graphics queue. The pointer is only
+    // good until the next stage call, which may flush to make room.
+    void* stageBuffer(VkBuffer dst, VkDeviceSize size, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+    // The same for an image, with region buffer offsets relative to the returned pointer.
+    // All mipLevels go from UNDEFINED to finalLayout, whether a region covers them or not.
+    void* stageImage(VkImage image, VkDeviceSize size, const VkBufferImageCopy* regions, uint32_t regionCount, uint32_t mipLevels,
+        VkImageLayout finalLayout, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess);
+
+    // graphics queue commands of the current batch, recorded after every acquire so far
+    VkCommandBuffer graphicsCommands();
+
+    // submits the current batch, if any, and waits for it
+    void flush();
+
+    AppUploaderStats getStats() const { return _stats; }
+
+private:
+    void createStaging(VkDeviceSize size);
+    void begin();
+    VkDeviceSize allocateStaging(VkDeviceSize size);
+    void transferOwnership(const VkBufferMemoryBarrier* bufferBarrier, const VkImageMemoryBarrier* imageBarrier, VkPipelineStageFlags dstStage);
+
+    VkDevice _device;
+    AppAllocator* _allocator;
+    VkQueue _graphicsQueue;
+    VkQueue _transferQueue;
+    uint32_t _graphicsFamily;
+    uint32_t _transferFamily;
+
+    VkCommandPool _transferPool;
+    VkCommandPool _graphicsPool;
+    VkCommandBuffer _transferCommands;
+    VkCommandBuffer _graphicsCommands;
+    // orders the graphics submission after the copies when they run on another queue
+    VkSemaphore _transferDone;
+    VkFence _batchDone;
+    bool _recording = false;
+
+    VkBuffer _stagingBuffer = VK_NULL_HANDLE;
+    AppAllocation _stagingMemory;
+    VkDeviceSize _stagingSize = 0;
+    VkDeviceSize _stagingHead = 0;
+
+    AppUploaderStats _stats = {};
+};
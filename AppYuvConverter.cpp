@@ -0,0 +1,171 @@
+#include "AppYuvConverter.h"
+#include "Shaders.h"
+
+#include <array>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using std::cout;
+using std::endl;
+
+namespace {
+    uint32_t groupCount(uint32_t size, uint32_t groupSize) {
+        return (size + groupSize - 1) / groupSize;
+    }
+}
+
+void AppYuvConverter::init(AppDevice* device, VkPipelineCache pipelineCache) {
+    _device = device->Device;
+    if (!Enabled)
+        return;
+
+    // the image through a sampler, the planes as plain words
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+    setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    setLayoutInfo.pBindings = bindings.data();
+    if (vkCreateDescriptorSetLayout(_device, &setLayoutInfo, nullptr, &_setLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create yuv descriptor set layout!");
+    }
+
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(YuvPushConstants);
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &_setLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    if (vkCreatePipelineLayout(_device, &layoutInfo, nullptr, &_pipelineLayout) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create yuv pipeline layout!");
+    }
+
+    _pipeline = Shaders::createComputePipeline(_device, pipelineCache, "shaders/yuv420.spv", _pipelineLayout);
+
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    if (vkCreateSampler(_device, &samplerInfo, nullptr, &_sampler) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create yuv sampler!");
+    }
+
+    cout << "capture: frames converted to YUV 4:2:0 on the GPU (" << (Coefficients.FullRange ? "full" : "studio") << " range)" << endl;
+}
+
+void AppYuvConverter::cleanup() {
+    if (!Enabled)
+        return;
+
+    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+    _descriptorPool = VK_NULL_HANDLE;
+    vkDestroySampler(_device, _sampler, nullptr);
+    vkDestroyPipeline(_device, _pipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _setLayout, nullptr);
+}
+
+void AppYuvConverter::createDescriptorSets(const std::vector<VkImageView>& views, const std::vector<VkBuffer>& buffers, VkExtent2D extent) {
+    if (!Enabled)
+        return;
+
+    _layout = Yuv420Layout::padded(extent.width, extent.height);
+
+    // the sets follow the swapchain, so the pool goes with it
+    vkDestroyDescriptorPool(_device, _descriptorPool, nullptr);
+
+    auto count = static_cast<uint32_t>(views.size());
+    std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = count;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = count;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = count;
+    if (vkCreateDescriptorPool(_device, &poolInfo, nullptr, &_descriptorPool) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create yuv descriptor pool!");
+    }
+
+    std::vector<VkDescriptorSetLayout> layouts(count, _setLayout);
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = _descriptorPool;
+    allocInfo.descriptorSetCount = count;
+    allocInfo.pSetLayouts = layouts.data();
+
+    _sets.resize(count);
+    if (vkAllocateDescriptorSets(_device, &allocInfo, _sets.data()) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate yuv descriptor sets!");
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        VkDescriptorImageInfo imageInfo = {};
+        imageInfo.sampler = _sampler;
+        imageInfo.imageView = views[i];
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        VkDescriptorBufferInfo bufferInfo = {};
+        bufferInfo.buffer = buffers[i];
+        bufferInfo.offset = 0;
+        bufferInfo.range = _layout.Size;
+
+        std::array<VkWriteDescriptorSet, 2> writes = {};
+        for (uint32_t j = 0; j < writes.size(); j++) {
+            writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[j].dstSet = _sets[i];
+            writes[j].dstBinding = j;
+            writes[j].descriptorCount = 1;
+        }
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &imageInfo;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[1].pBufferInfo = &bufferInfo;
+
+        vkUpdateDescriptorSets(_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void AppYuvConverter::record(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    YuvPushConstants constants;
+    for (int i = 0; i < 4; i++) {
+        constants.YRow[i] = Coefficients.Y[i];
+        constants.URow[i] = Coefficients.U[i];
+        constants.VRow[i] = Coefficients.V[i];
+    }
+    constants.Width = _layout.Width;
+    constants.Height = _layout.Height;
+    constants.YStride = _layout.YStride;
+    constants.CStride = _layout.CStride;
+    constants.UOffset = static_cast<uint32_t>(_layout.UOffset);
+    constants.VOffset = static_cast<uint32_t>(_layout.VOffset);
+    constants.Flip = Flip ? 1 : 0;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipelineLayout, 0, 1, &_sets[imageIndex], 0, nullptr);
+    vkCmdPushConstants(commandBuffer, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+    // 8x8 invocations of 8x2 pixels each
+    vkCmdDispatch(commandBuffer, groupCount(_layout.Width, 64), groupCount(_layout.Height, 16), 1);
+}
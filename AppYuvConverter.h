@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "AppDevice.h"
+#include "Yuv420.h"
+
+#include <cstdint>
+#include <vector>
+
+// matches the push constant block of yuv420.comp
+struct YuvPushConstants {
+    float YRow[4];
+    float URow[4];
+    float VRow[4];
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t YStride;
+    uint32_t CStride;
+    uint32_t UOffset;
+    uint32_t VOffset;
+    uint32_t Flip;
+};
+
+static_assert(sizeof(YuvPushConstants) == 76, "YuvPushConstants must match the push constants in yuv420.comp");
+
+// Compute pass that turns the rendered image into 4:2:0 planes (Yuv420Layout::padded)
+// in its readback buffer, so 1.5 bytes per pixel cross the bus instead of 4 and
+// the capture threads only have to repack rows.
+class AppYuvConverter {
+public:
+    // set before init(); the target images need VK_IMAGE_USAGE_SAMPLED_BIT while it's on
+    bool Enabled = false;
+    YuvCoefficients Coefficients = YuvCoefficients::make(YuvMatrix::Bt601, true);
+    // bottom row first, like PixelConverter's flip
+    bool Flip = false;
+
+    void init(AppDevice* device, VkPipelineCache pipelineCache);
+    void cleanup();
+
+    // one set per target image, reading its view and writing its readback buffer
+    void createDescriptorSets(const std::vector<VkImageView>& views, const std::vector<VkBuffer>& buffers, VkExtent2D extent);
+
+    // with the target in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL; the planes start at offset 0
+    void record(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+
+    Yuv420Layout layout() const { return _layout; }
+
+private:
+    VkDevice _device;
+
+    VkDescriptorSetLayout _setLayout;
+    VkPipelineLayout _pipelineLayout;
+    VkPipeline _pipeline;
+    VkSampler _sampler;
+    VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> _sets;
+
+    Yuv420Layout _layout;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's
+// array queue). Every cell carries a sequence number, so producers and
+// consumers only contend on their own position counter.
+template<typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) {
+		_capacity = 1;
+		while (_capacity < capacity)
+			_capacity <<= 1;
+		_mask = _capacity - 1;
+
+		_cells.reset(new Cell[_capacity]);
+		for (size_t i = 0; i < _capacity; i++) {
+			_cells[i].Sequence.store(i, std::memory_order_relaxed);
+		}
+		_enqueuePos.store(0, std::memory_order_relaxed);
+		_dequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	// returns false when the queue is full
+	bool push(const T& value) {
+		Cell* cell;
+		size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &_cells[pos & _mask];
+			size_t seq = cell->Sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) {
+				if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = _enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+		cell->Value = value;
+		cell->Sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// returns false when the queue is empty
+	bool pop(T& value) {
+		Cell* cell;
+		size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &_cells[pos & _mask];
+			size_t seq = cell->Sequence.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = _dequeuePos.load(std::memory_order_relaxed);
+			}
+		}
+		value = cell->Value;
+		cell->Sequence.store(pos + _mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	// approximate while other threads are pushing or popping
+	size_t size() const {
+		size_t enqueued = _enqueuePos.load(std::memory_order_relaxed);
+		size_t dequeued = _dequeuePos.load(std::memory_order_relaxed);
+		return enqueued > dequeued ? enqueued - dequeued : 0;
+	}
+
+	size_t capacity() const {
+		return _capacity;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t> Sequence;
+		T Value;
+	};
+
+	// keep the two hot counters on separate cache lines
+	alignas(64) std::unique_ptr<Cell[]> _cells;
+	size_t _capacity;
+	size_t _mask;
+	alignas(64) std::atomic<size_t> _enqueuePos;
+	alignas(64) std::atomic<size_t> _dequeuePos;
+};
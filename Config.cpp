@@ -0,0 +1,197 @@
+#include "Config.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+	std::string trim(const std::string& s) {
+		size_t first = 0;
+		while (first < s.size() && isspace(static_cast<unsigned char>(s[first])))
+			first++;
+		size_t last = s.size();
+		while (last > first && isspace(static_cast<unsigned char>(s[last - 1])))
+			last--;
+		return s.substr(first, last - first);
+	}
+
+	std::string lower(std::string s) {
+		std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+		return s;
+	}
+
+	bool parseBool(const std::string& value, bool& out) {
+		auto v = lower(value);
+		if (v == "on" || v == "true" || v == "yes" || v == "1") {
+			out = true;
+			return true;
+		}
+		if (v == "off" || v == "false" || v == "no" || v == "0") {
+			out = false;
+			return true;
+		}
+		return false;
+	}
+
+	bool parseCount(const std::string& value, uint32_t& out) {
+		if (value.empty() || !std::all_of(value.begin(), value.end(), [](unsigned char c) { return isdigit(c); }))
+			return false;
+		try {
+			out = static_cast<uint32_t>(std::stoul(value));
+		} catch (const std::exception&) {
+			return false;
+		}
+		return true;
+	}
+
+	const char* const filteringNames[] = {
+		"none", "bilinear", "trilinear", "anisotropic1", "anisotropic2", "anisotropic4", "anisotropic8", "anisotropic16"
+	};
+
+	const char* backpressureName(ImageWriterBackpressure backpressure) {
+		switch (backpressure) {
+		case ImageWriterBackpressure::Block: return "block";
+		case ImageWriterBackpressure::DropOldest: return "drop-oldest";
+		case ImageWriterBackpressure::Skip: return "skip";
+		}
+		return "";
+	}
+
+	const char* presentModeName(PresentModeType mode) {
+		switch (mode) {
+		case PresentModeType::Fifo: return "fifo";
+		case PresentModeType::Mailbox: return "mailbox";
+		case PresentModeType::Immediate: return "immediate";
+		}
+		return "";
+	}
+}
+
+bool Config::applyPreset(const std::string& name) {
+	auto preset = lower(name);
+	if (preset == "default") {
+		*this = Config();
+	} else if (preset == "low-latency") {
+		// one frame queued anywhere: the CPU waits for the GPU, mailbox drops stale images,
+		// and nothing is read back behind the frame
+		*this = Config();
+		PresentMode = PresentModeType::Mailbox;
+		FramesInFlight = 1;
+		SwapchainImages = 2;
+		MsaaSamples = 4;
+		SaveToFile = false;
+		CaptureLimit = 0;
+	} else if (preset == "max-throughput") {
+		// deep queues so neither side waits for the other, never blocked on vsync,
+		// and the cheapest raster so captured frames come out as fast as possible
+		*this = Config();
+		PresentMode = PresentModeType::Immediate;
+		FramesInFlight = 3;
+		SwapchainImages = 4;
+		MsaaSamples = 1;
+		SaveToFile = true;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool Config::load(const std::string& path, std::string& error) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		error = "cannot open " + path;
+		return false;
+	}
+
+	std::string line;
+	for (int number = 1; std::getline(file, line); number++) {
+		auto comment = line.find('#');
+		if (comment != std::string::npos)
+			line.resize(comment);
+		line = trim(line);
+		if (line.empty())
+			continue;
+
+		auto equals = line.find('=');
+		if (equals == std::string::npos || !set(trim(line.substr(0, equals)), trim(line.substr(equals + 1)))) {
+			error = path + ":" + std::to_string(number) + ": " + line;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Config::set(const std::string& key, const std::string& value) {
+	auto k = lower(key);
+	auto v = lower(value);
+
+	if (k == "preset") {
+		return applyPreset(v);
+	} else if (k == "present_mode") {
+		if (v == "fifo") {
+			PresentMode = PresentModeType::Fifo;
+		} else if (v == "mailbox") {
+			PresentMode = PresentModeType::Mailbox;
+		} else if (v == "immediate") {
+			PresentMode = PresentModeType::Immediate;
+		} else {
+			return false;
+		}
+		return true;
+	} else if (k == "vsync") {
+		bool vsync;
+		if (!parseBool(v, vsync))
+			return false;
+		// keeps mailbox, which already waits for vsync
+		if (!vsync) {
+			PresentMode = PresentModeType::Immediate;
+		} else if (PresentMode == PresentModeType::Immediate) {
+			PresentMode = PresentModeType::Fifo;
+		}
+		return true;
+	} else if (k == "frames_in_flight") {
+		uint32_t frames;
+		if (!parseCount(v, frames) || frames == 0)
+			return false;
+		FramesInFlight = frames;
+		return true;
+	} else if (k == "swapchain_images") {
+		return parseCount(v, SwapchainImages);
+	} else if (k == "msaa") {
+		return parseCount(v, MsaaSamples);
+	} else if (k == "texture_filtering") {
+		for (int i = 0; i <= Anisotropic16; i++) {
+			if (v == filteringNames[i]) {
+				TextureFiltering = static_cast<TextureFilteringType>(i);
+				return true;
+			}
+		}
+		return false;
+	} else if (k == "shadows") {
+		return parseBool(v, Shadows);
+	} else if (k == "capture") {
+		return parseBool(v, SaveToFile);
+	} else if (k == "capture_backpressure") {
+		if (v == "block") {
+			CaptureBackpressure = ImageWriterBackpressure::Block;
+		} else if (v == "drop-oldest") {
+			CaptureBackpressure = ImageWriterBackpressure::DropOldest;
+		} else if (v == "skip") {
+			CaptureBackpressure = ImageWriterBackpressure::Skip;
+		} else {
+			return false;
+		}
+		return true;
+	} else if (k == "capture_limit") {
+		return parseCount(v, CaptureLimit);
+	}
+	return false;
+}
+
+void Config::print(std::ostream& out) const {
+	out << "config: " << presentModeName(PresentMode) << ", " << FramesInFlight << " frames in flight, "
+	    << (SwapchainImages > 0 ? std::to_string(SwapchainImages) : std::string("default")) << " swapchain images, "
+	    << (MsaaSamples > 0 ? std::to_string(MsaaSamples) + "x" : std::string("max")) << " MSAA, " << filteringNames[TextureFiltering] << " filtering, capture "
+	    << (SaveToFile ? (CaptureLimit > 0 ? std::to_string(CaptureLimit) + " frames" : std::string("unlimited")) + ", " + backpressureName(CaptureBackpressure) + " when the writer is full" : std::string("off"));
+}
@@ -1,5 +1,11 @@
 #pragma once
 
+#include "ImageWriter.h"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
 enum AAType {
 	MSAA
 };
@@ -15,14 +21,55 @@ enum TextureFilteringType {
 	Anisotropic16
 };
 
+// preferred present mode, FIFO is used whenever the preferred one is missing
+enum class PresentModeType {
+	Fifo,      // vsync, every image shown, latency grows with the queue
+	Mailbox,   // vsync, newer images replace queued ones
+	Immediate  // no vsync, tears
+};
 
+// Runtime settings, read from a preset, a file and the command line in that
+// order. The defaults are what the app did before it had any of this.
+//
+// Files hold one "key = value" per line, '#' starts a comment:
+//   preset = max-throughput
+//   present_mode = mailbox      # fifo, mailbox, immediate
+//   vsync = off                 # shorthand for fifo / immediate
+//   frames_in_flight = 2
+//   swapchain_images = 0        # 0 for the surface minimum + 1
+//   msaa = 4                    # 0 for the device maximum
+//   texture_filtering = anisotropic16
+//   capture = on
+//   capture_backpressure = block  # block, drop-oldest, skip
+//   capture_limit = 1000        # 0, or capture = off, to run until the window closes
 class Config {
 public:
-	bool VSync = true;
-	AAType AA;
-	TextureFilteringType TextureFiltering;
+	PresentModeType PresentMode = PresentModeType::Mailbox;
+	uint32_t FramesInFlight = 2;
+	// swapchain images, or offscreen targets when headless; 0 picks the default
+	uint32_t SwapchainImages = 0;
 
+	AAType AA = MSAA;
+	// 0 for the most the device supports, rounded down to a supported count
+	uint32_t MsaaSamples = 0;
+	TextureFilteringType TextureFiltering = Anisotropic16;
+
+	// there is no shadow pass yet, the setting is only carried along
 	bool Shadows = true;
 
-	bool SaveToFile = false;
+	// read rendered frames back and capture them, off leaves only the rendering
+	bool SaveToFile = true;
+	// what saving a frame does while every writer buffer is busy
+	ImageWriterBackpressure CaptureBackpressure = ImageWriterBackpressure::Block;
+	// captured frames before the app stops, 0 for no limit; without capture it runs until closed
+	uint32_t CaptureLimit = 1000;
+
+	// "default", "low-latency" or "max-throughput"; false for any other name
+	bool applyPreset(const std::string& name);
+	// false with the offending line in error
+	bool load(const std::string& path, std::string& error);
+	// one key from a file or the command line; false for an unknown key or a bad value
+	bool set(const std::string& key, const std::string& value);
+
+	void print(std::ostream& out) const;
 };
@@ -0,0 +1,57 @@
+#pragma once
+
+// Runtime checks for the x86 instruction sets above the x86-64 SSE2 baseline.
+// Paths marked CPU_TARGET("avx2") are built into every binary without -mavx2
+// and only taken when CpuFeatures says the running CPU has them. MSVC accepts
+// any intrinsic in any function, so the marker is empty there.
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define CPU_X86
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CPU_TARGET(isa)
+#else
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+class CpuFeatures {
+public:
+    bool Ssse3 = false;
+    bool Avx2 = false;
+
+    // detected on first use
+    static const CpuFeatures& get() {
+        static const CpuFeatures features = detect();
+        return features;
+    }
+
+private:
+    static CpuFeatures detect() {
+        CpuFeatures features;
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        features.Ssse3 = (info[2] & (1 << 9)) != 0;
+        // AVX registers also have to be saved by the OS, not just present in the CPU
+        bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+        if (osAvx && maxLeaf >= 7) {
+            __cpuidex(info, 7, 0);
+            features.Avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        features.Ssse3 = __builtin_cpu_supports("ssse3") != 0;
+        features.Avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+        return features;
+    }
+};
+
+#endif
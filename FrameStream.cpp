@@ -0,0 +1,135 @@
+#include "FrameStream.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+	// large enough that a chunk covers several frames at typical window sizes
+	const size_t chunkSize = 4 * 1024 * 1024;
+	const size_t chunkAlignment = 4096;
+}
+
+FrameStream::~FrameStream() {
+	close();
+}
+
+void FrameStream::open(CaptureFormat format, const std::string& target, int fps, bool fullRange) {
+	close();
+
+	_format = format;
+	_fps = fps;
+	_fullRange = fullRange;
+	_width = 0;
+	_height = 0;
+
+	if (format == CaptureFormat::Pipe) {
+#ifdef _WIN32
+		_file = _popen(target.c_str(), "wb");
+#else
+		// an encoder that exits early should fail the writes, not kill the app
+		std::signal(SIGPIPE, SIG_IGN);
+		_file = popen(target.c_str(), "w");
+#endif
+	} else {
+		_file = std::fopen(target.c_str(), "wb");
+	}
+	if (!_file) {
+		throw std::runtime_error("failed to open capture output " + target + "!");
+	}
+	// everything goes through the chunk buffer already
+	std::setvbuf(_file, nullptr, _IONBF, 0);
+
+	if (_storage.empty()) {
+		_storage.resize(chunkSize + chunkAlignment);
+		auto address = reinterpret_cast<uintptr_t>(_storage.data());
+		_chunk = _storage.data() + (chunkAlignment - address % chunkAlignment) % chunkAlignment;
+	}
+	_used = 0;
+	_failed = false;
+	_frames = 0;
+	_bytes = 0;
+	_writeNanoseconds = 0;
+}
+
+void FrameStream::close() {
+	if (!_file)
+		return;
+
+	flushChunk(_used);
+	if (_format == CaptureFormat::Pipe) {
+#ifdef _WIN32
+		_pclose(_file);
+#else
+		pclose(_file);
+#endif
+	} else {
+		std::fclose(_file);
+	}
+	_file = nullptr;
+}
+
+bool FrameStream::write(const char* data, size_t size, int width, int height) {
+	bool y4m = _format == CaptureFormat::Y4m || _format == CaptureFormat::Pipe;
+	if (_frames == 0) {
+		_firstFrame = std::chrono::high_resolution_clock::now();
+		_width = width;
+		_height = height;
+
+		if (y4m) {
+			// C420jpeg puts chroma between the luma samples, which is what a plain 2x2 average gives
+			auto header = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F" + std::to_string(_fps) +
+				":1 Ip A1:1 C420jpeg XCOLORRANGE=" + (_fullRange ? "FULL" : "LIMITED") + "\n";
+			append(header.data(), header.size());
+		}
+	} else if (y4m && (width != _width || height != _height)) {
+		// a Y4M stream has one frame size for its whole length
+		return false;
+	}
+
+	append(data, size);
+	_frames++;
+	return true;
+}
+
+FrameStreamStats FrameStream::getStats() const {
+	FrameStreamStats stats = {};
+	stats.Frames = _frames;
+	stats.Bytes = _bytes;
+	if (_bytes > 0)
+		stats.Seconds = std::chrono::duration<double, std::chrono::seconds::period>(_lastWrite - _firstFrame).count();
+	stats.WriteSeconds = _writeNanoseconds / 1e9;
+	return stats;
+}
+
+void FrameStream::append(const char* data, size_t size) {
+	while (size > 0) {
+		size_t n = std::min(size, chunkSize - _used);
+		memcpy(_chunk + _used, data, n);
+		_used += n;
+		data += n;
+		size -= n;
+
+		if (_used == chunkSize)
+			flushChunk(_used);
+	}
+}
+
+void FrameStream::flushChunk(size_t size) {
+	if (size == 0)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	_used = 0;
+	if (_failed)
+		return;
+	// no exceptions here, this runs on the encoder threads
+	if (std::fwrite(_chunk, 1, size, _file) != size) {
+		_failed = true;
+		return;
+	}
+	_lastWrite = std::chrono::high_resolution_clock::now();
+	_writeNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(_lastWrite - start).count();
+	_bytes += size;
+}
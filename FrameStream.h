@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+enum class CaptureFormat {
+	Bmp,  // one images/imgN.bmp per frame
+	Raw,  // RGBA8 (or RGB8) frames back to back, no header
+	Y4m,  // YUV4MPEG2 with 4:2:0 chroma, playable and encodable as is
+	Pipe  // Y4M into the stdin of an encoder process
+};
+
+struct FrameStreamStats {
+	uint64_t Frames;
+	uint64_t Bytes;
+	// from the first frame to the last write
+	double Seconds;
+	// spent inside fwrite, the rest is the stream waiting for frames
+	double WriteSeconds;
+};
+
+// Appends encoded frames to one file or pipe. Frames are gathered in a large
+// page aligned buffer and written out in whole chunks, so the disk or the
+// encoder sees a few big sequential writes instead of one per frame.
+// Not thread safe, ImageWriter hands it one frame at a time in order.
+class FrameStream {
+public:
+	FrameStream() = default;
+	~FrameStream();
+
+	FrameStream(const FrameStream&) = delete;
+	FrameStream& operator=(const FrameStream&) = delete;
+
+	// target is a file for Raw and Y4m and a shell command for Pipe
+	// fullRange only goes into the Y4M header
+	void open(CaptureFormat format, const std::string& target, int fps, bool fullRange = true);
+	// writes whatever is buffered and closes the file or waits for the encoder to exit
+	void close();
+	bool isOpen() const { return _file != nullptr; }
+	// set once a write came up short, e.g. the disk is full or the encoder exited
+	bool failed() const { return _failed; }
+
+	// returns false when a Y4M stream gets a frame of a different size than its header
+	bool write(const char* data, size_t size, int width, int height);
+
+	FrameStreamStats getStats() const;
+
+private:
+	void append(const char* data, size_t size);
+	void flushChunk(size_t size);
+
+	CaptureFormat _format = CaptureFormat::Raw;
+	std::FILE* _file = nullptr;
+	int _fps = 60;
+	bool _fullRange = true;
+	int _width = 0;
+	int _height = 0;
+
+	std::vector<char> _storage;
+	char* _chunk = nullptr;
+	size_t _used = 0;
+	bool _failed = false;
+
+	uint64_t _frames = 0;
+	uint64_t _bytes = 0;
+	uint64_t _writeNanoseconds = 0;
+	std::chrono::high_resolution_clock::time_point _firstFrame;
+	std::chrono::high_resolution_clock::time_point _lastWrite;
+};
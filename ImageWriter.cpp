@@ -3,14 +3,256 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb/stb_image_write.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <sstream>
+#include <stdexcept>
 
-void ImageWriter::work(ImageWriterData* data) {
-	std::stringstream filenamestream;
-    filenamestream << "images/";
-    filenamestream << "img" << data->Index << ".bmp";
-    std::string filename = filenamestream.str();
-    const char* fname = filename.c_str();
+namespace {
+	unsigned poolSize(unsigned threads) {
+		return threads > 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+	}
 
-	stbi_write_bmp(fname, data->Width, data->Height, data->Comp, data->Data);
+	// two buffers per encoder keeps every thread busy while the render thread fills the next one
+	unsigned bufferCount(unsigned threads) {
+		return std::max(2 * poolSize(threads), 4u);
+	}
+}
+
+ImageWriter::ImageWriter(ImageWriterBackpressure backpressure, unsigned threads)
+	: _backpressure(backpressure),
+	  _free(bufferCount(threads)),
+	  _work(bufferCount(threads)) {
+	for (unsigned i = 0; i < bufferCount(threads); i++) {
+		auto data = new ImageWriterData();
+		_data.push_back(data);
+		_free.push(data);
+	}
+
+	for (unsigned i = 0; i < poolSize(threads); i++) {
+		_threads.push_back(std::thread(&ImageWriter::workerLoop, this));
+	}
+}
+
+ImageWriter::~ImageWriter() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_workAvailable.notify_all();
+
+	// workers drain whatever is still queued before they exit
+	for (auto& t : _threads) {
+		if (t.joinable())
+			t.join();
+	}
+
+	for (auto data : _data) {
+		delete data;
+	}
+}
+
+void ImageWriter::open(CaptureFormat format, const std::string& target, const YuvCoefficients& coefficients, int fps) {
+	_format = format;
+	_coefficients = coefficients;
+	if (format != CaptureFormat::Bmp)
+		_stream.open(format, target, fps, coefficients.FullRange);
+}
+
+void ImageWriter::finish() {
+	// every buffer back in the free queue means every frame went through the stream
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_bufferAvailable.wait(lock, [this] { return _free.size() == _data.size(); });
+	}
+
+	std::lock_guard<std::mutex> lock(_streamMutex);
+	_stream.close();
+	if (_stream.failed()) {
+		throw std::runtime_error("failed to write capture output!");
+	}
+}
+
+ImageWriterData* ImageWriter::getNext() {
+	ImageWriterData* data = nullptr;
+	if (_free.pop(data))
+		return data;
+
+	switch (_backpressure) {
+	case ImageWriterBackpressure::Skip:
+		_skipped++;
+		return nullptr;
+
+	case ImageWriterBackpressure::DropOldest:
+		if (_work.pop(data)) {
+			_dropped++;
+			// the stream must not wait for it; this may write frames queued behind it on this thread
+			commit(data->Sequence, nullptr);
+			return data;
+		}
+		// everything is being encoded right now, nothing to reclaim
+		break;
+
+	case ImageWriterBackpressure::Block:
+		break;
+	}
+
+	_stalls++;
+	auto start = std::chrono::high_resolution_clock::now();
+	while (!_free.pop(data)) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_bufferAvailable.wait(lock, [this] { return _free.size() > 0; });
+	}
+	auto stalled = std::chrono::high_resolution_clock::now() - start;
+	_stallNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(stalled).count();
+
+	return data;
+}
+
+void ImageWriter::write(ImageWriterData* data) {
+	data->Sequence = _nextSequence++;
+
+	// cannot fail, there are never more buffers than queue slots
+	_work.push(data);
+
+	auto depth = _work.size();
+	auto maxDepth = _maxQueueDepth.load(std::memory_order_relaxed);
+	while (depth > maxDepth && !_maxQueueDepth.compare_exchange_weak(maxDepth, depth)) {
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+	}
+	_workAvailable.notify_one();
+}
+
+ImageWriterStats ImageWriter::getStats() const {
+	ImageWriterStats stats = {};
+	stats.QueueDepth = _work.size();
+	stats.MaxQueueDepth = _maxQueueDepth.load();
+	stats.Written = _written.load();
+	stats.Stalls = _stalls.load();
+	stats.StallSeconds = _stallNanoseconds.load() / 1e9;
+	stats.Dropped = _dropped.load();
+	stats.Skipped = _skipped.load();
+	{
+		std::lock_guard<std::mutex> lock(_streamMutex);
+		stats.Stream = _stream.getStats();
+	}
+	return stats;
+}
+
+void ImageWriter::release(ImageWriterData* data) {
+	_free.push(data);
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+	}
+	_bufferAvailable.notify_one();
+}
+
+void ImageWriter::workerLoop() {
+	for (;;) {
+		ImageWriterData* data = nullptr;
+		if (_work.pop(data)) {
+			{
+				ProfileScope scope(_profiler, "encode", data->Frame);
+				encode(data);
+			}
+			commit(data->Sequence, data);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (_stopping && _work.size() == 0)
+			return;
+		_workAvailable.wait(lock, [this] { return _stopping || _work.size() > 0; });
+	}
+}
+
+void ImageWriter::commit(uint64_t sequence, ImageWriterData* data) {
+	std::unique_lock<std::mutex> lock(_orderMutex);
+	_pending[sequence] = data;
+	if (_draining)
+		return;
+
+	// drain everything that is next in line, other threads keep adding to
+	// _pending meanwhile and leave the writing to this one
+	_draining = true;
+	for (;;) {
+		auto it = _pending.find(_nextWrite);
+		if (it == _pending.end())
+			break;
+		auto next = it->second;
+		_pending.erase(it);
+		_nextWrite++;
+		lock.unlock();
+
+		if (next) {
+			ProfileScope scope(_profiler, "write", next->Frame);
+			std::unique_lock<std::mutex> streamLock(_streamMutex);
+			bool written = true;
+			if (_format == CaptureFormat::Raw && next->Pixels == ImageWriterPixels::Rgba) {
+				written = _stream.write(next->Data.data(), next->Data.size(), next->Width, next->Height);
+			} else if (_format != CaptureFormat::Bmp) {
+				written = _stream.write(next->Encoded.data(), next->Encoded.size(), next->Width, next->Height);
+			}
+			streamLock.unlock();
+			// a Y4M stream keeps the size it started with, frames after a resize are dropped
+			if (written)
+				_written++;
+			else
+				_dropped++;
+			release(next);
+		}
+
+		lock.lock();
+	}
+	_draining = false;
+}
+
+void ImageWriter::encode(ImageWriterData* data) {
+	switch (_format) {
+	case CaptureFormat::Bmp: {
+		std::stringstream filenamestream;
+		filenamestream << "images/";
+		filenamestream << "img" << data->Index << ".bmp";
+		std::string filename = filenamestream.str();
+
+		stbi_write_bmp(filename.c_str(), data->Width, data->Height, data->Comp, data->Data.data());
+		break;
+	}
+
+	case CaptureFormat::Y4m:
+	case CaptureFormat::Pipe:
+		encodeY4m(*data, _coefficients, data->Encoded);
+		break;
+
+	case CaptureFormat::Raw:
+		// RGBA readbacks are already the frame, planes still lose their padding
+		if (data->Pixels == ImageWriterPixels::Yuv420) {
+			auto layout = Yuv420Layout::packed(data->Width, data->Height);
+			data->Encoded.resize(layout.Size);
+			Yuv420::repack(reinterpret_cast<const uint8_t*>(data->Data.data()), Yuv420Layout::padded(data->Width, data->Height),
+				reinterpret_cast<uint8_t*>(data->Encoded.data()), layout);
+		}
+		break;
+	}
+}
+
+void ImageWriter::encodeY4m(const ImageWriterData& data, const YuvCoefficients& coefficients, std::vector<char>& out) {
+	static const char frameHeader[] = "FRAME\n";
+	const size_t headerSize = sizeof(frameHeader) - 1;
+
+	auto layout = Yuv420Layout::packed(data.Width, data.Height);
+	out.resize(headerSize + layout.Size);
+	memcpy(out.data(), frameHeader, headerSize);
+
+	auto src = reinterpret_cast<const uint8_t*>(data.Data.data());
+	auto planes = reinterpret_cast<uint8_t*>(out.data() + headerSize);
+	if (data.Pixels == ImageWriterPixels::Yuv420) {
+		Yuv420::repack(src, Yuv420Layout::padded(data.Width, data.Height), planes, layout);
+	} else {
+		Yuv420::convert(src, static_cast<size_t>(data.Width) * 4, false, coefficients, layout, planes);
+	}
 }
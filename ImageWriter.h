@@ -1,59 +1,136 @@
 #pragma once
 
-#include <vector>
+#include "BoundedQueue.h"
+#include "FrameStream.h"
+#include "Profiler.h"
+#include "Yuv420.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
 #include <thread>
+#include <vector>
+
+enum class ImageWriterPixels {
+	Rgba,
+	// planes in Yuv420Layout::padded, converted on the GPU
+	Yuv420
+};
 
 class ImageWriterData {
 public:
-	const char* Data;
+	std::vector<char> Data;
 	//const char* Filename;
 	int Width;
 	int Height;
 	int Comp;
-	int Index;
+	// frame number counted from StartFrame, also what bmp captures are named after
+	int64_t Index;
+	ImageWriterPixels Pixels = ImageWriterPixels::Rgba;
+	// order the frame goes into the stream, assigned by write()
+	uint64_t Sequence;
+	// the frame as it goes into the stream when that differs from Data
+	std::vector<char> Encoded;
+	// draw frame it was rendered in, what the profiler files encode and write under
+	int64_t Frame = -1;
 };
 
+// what getNext() does when every buffer is queued or being encoded
+enum class ImageWriterBackpressure {
+	Block,      // wait for an encoder to hand a buffer back
+	DropOldest, // reclaim the oldest frame that has not been picked up yet
+	Skip        // return nullptr, the caller drops the current frame
+};
+
+struct ImageWriterStats {
+	size_t QueueDepth;
+	size_t MaxQueueDepth;
+	uint64_t Written;
+	uint64_t Stalls;
+	double StallSeconds;
+	uint64_t Dropped;
+	uint64_t Skipped;
+	// only final once finish() returned
+	FrameStreamStats Stream;
+};
+
+// Fixed pool of encoder threads fed through a bounded lock-free queue.
+// Frame buffers circulate between a free queue and a work queue, so nothing
+// is allocated or spawned per frame once the pool is warm.
+//
+// Frames are encoded in parallel but reach the FrameStream in the order they
+// were written: each gets a sequence number, finished frames wait in a small
+// reorder buffer and whichever encoder completes the next one in line writes
+// it along with every frame already waiting behind it.
 class ImageWriter {
 public:
-	ImageWriter() {
-		for (auto i = 0; i < _maxThreads; i++) {
-			_threads.push_back(std::thread());
-
-			auto data = new ImageWriterData();
-			//data->Filename = (const char*)malloc(256);
-			data->Data = (const char*)malloc(1920 * 1080 * 4);
-			_data.push_back(data);
-		}
-	}
-
-	~ImageWriter() {
-		for (auto i = 0; i < _maxThreads; i++) {
-			auto& t = _threads[i];
-			if (t.joinable())
-				t.join();
-			delete _data[i];
-		}
-	}
-
-	ImageWriterData* getNext() {
-		_threadIndex = (_threadIndex + 1) % _maxThreads;
-
-		if (_threads[_threadIndex].joinable())
-			_threads[_threadIndex].join();
-
-		return _data[_threadIndex];
-	}
-
-	// call getNext() before me
-	void write() {
-		_threads[_threadIndex] = std::thread(work, _data[_threadIndex]);
-	}
-
-	static void work(ImageWriterData* data);
+	// threads = 0 sizes the pool to the core count
+	ImageWriter(ImageWriterBackpressure backpressure = ImageWriterBackpressure::Block, unsigned threads = 0);
+	~ImageWriter();
+
+	ImageWriter(const ImageWriter&) = delete;
+	ImageWriter& operator=(const ImageWriter&) = delete;
+
+	// call before the first frame, without it every frame is saved as a BMP
+	void open(CaptureFormat format, const std::string& target, const YuvCoefficients& coefficients, int fps = 60);
+	// encode and stream write scopes go here; the profiler has to outlive the writer
+	void setProfiler(Profiler* profiler) { _profiler = profiler; }
+	// waits for every frame handed to write() to be in the stream, then closes it
+	void finish();
+
+	// may return nullptr with ImageWriterBackpressure::Skip
+	ImageWriterData* getNext();
+
+	// hands a buffer from getNext() to the encoder threads
+	void write(ImageWriterData* data);
+
+	ImageWriterStats getStats() const;
+
+	// a Y4M frame: "FRAME\n" and tightly packed Y, U and V planes
+	static void encodeY4m(const ImageWriterData& data, const YuvCoefficients& coefficients, std::vector<char>& out);
 
 private:
-	const int _maxThreads = 100;
+	void workerLoop();
+	void encode(ImageWriterData* data);
+	// data is nullptr for a frame that was dropped after getting its sequence number
+	void commit(uint64_t sequence, ImageWriterData* data);
+	void release(ImageWriterData* data);
+
+	ImageWriterBackpressure _backpressure;
 	std::vector<std::thread> _threads;
 	std::vector<ImageWriterData*> _data;
-	int _threadIndex = 0;
+
+	BoundedQueue<ImageWriterData*> _free;
+	BoundedQueue<ImageWriterData*> _work;
+
+	// only used to sleep when a queue is empty, never to guard the queues
+	std::mutex _mutex;
+	std::condition_variable _workAvailable;
+	std::condition_variable _bufferAvailable;
+	bool _stopping = false;
+
+	CaptureFormat _format = CaptureFormat::Bmp;
+	YuvCoefficients _coefficients = YuvCoefficients::make(YuvMatrix::Bt601, true);
+	FrameStream _stream;
+	// the drain writes to the stream outside _orderMutex, this keeps getStats() from reading it mid-write
+	mutable std::mutex _streamMutex;
+	Profiler* _profiler = nullptr;
+	// only touched by the thread calling write()
+	uint64_t _nextSequence = 0;
+
+	// reorder buffer, the stream itself is only written by the thread that set _draining
+	std::mutex _orderMutex;
+	std::map<uint64_t, ImageWriterData*> _pending;
+	uint64_t _nextWrite = 0;
+	bool _draining = false;
+
+	std::atomic<size_t> _maxQueueDepth{0};
+	std::atomic<uint64_t> _written{0};
+	std::atomic<uint64_t> _stalls{0};
+	std::atomic<uint64_t> _stallNanoseconds{0};
+	std::atomic<uint64_t> _dropped{0};
+	std::atomic<uint64_t> _skipped{0};
 };
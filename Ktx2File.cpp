@@ -0,0 +1,178 @@
+#include "Ktx2File.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const uint8_t ktx2Identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+    // a full chain of 32 bit sizes never has more, and level sizes are shifted by the level index
+    const uint32_t maxLevels = 32;
+
+    struct Ktx2Header {
+        uint8_t Identifier[12];
+        uint32_t VkFormat;
+        uint32_t TypeSize;
+        uint32_t PixelWidth;
+        uint32_t PixelHeight;
+        uint32_t PixelDepth;
+        uint32_t LayerCount;
+        uint32_t FaceCount;
+        uint32_t LevelCount;
+        uint32_t SupercompressionScheme;
+        uint32_t DfdByteOffset;
+        uint32_t DfdByteLength;
+        uint32_t KvdByteOffset;
+        uint32_t KvdByteLength;
+        uint64_t SgdByteOffset;
+        uint64_t SgdByteLength;
+    };
+
+    static_assert(sizeof(Ktx2Header) == 80, "Ktx2Header must match the KTX2 file layout");
+
+    struct Ktx2LevelIndex {
+        uint64_t ByteOffset;
+        uint64_t ByteLength;
+        uint64_t UncompressedByteLength;
+    };
+
+    // Khronos data format descriptor values for the basic descriptor block
+    const uint32_t dfdModelBC1A = 128;
+    const uint32_t dfdModelBC7 = 134;
+    const uint32_t dfdPrimariesBT709 = 1;
+    const uint32_t dfdTransferLinear = 1;
+    const uint32_t dfdTransferSRGB = 2;
+
+    bool isSrgb(VkFormat format) {
+        return format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC7_SRGB_BLOCK;
+    }
+
+    // one basic descriptor block with a single sample covering the whole block
+    std::vector<uint32_t> dataFormatDescriptor(VkFormat format) {
+        uint32_t model = Ktx2File::blockSize(format) == 8 ? dfdModelBC1A : dfdModelBC7;
+        uint32_t bytes = Ktx2File::blockSize(format);
+        uint32_t blockWords = 6 + 4;
+
+        std::vector<uint32_t> dfd;
+        dfd.push_back(4 + blockWords * 4);
+        // vendor 0 (Khronos), descriptor type 0 (basic), version 2, block size
+        dfd.push_back(0);
+        dfd.push_back(2 | ((blockWords * 4) << 16));
+        dfd.push_back(model | (dfdPrimariesBT709 << 8) | ((isSrgb(format) ? dfdTransferSRGB : dfdTransferLinear) << 16));
+        // 4x4 texel blocks, stored as dimension - 1
+        dfd.push_back(3 | (3 << 8));
+        dfd.push_back(bytes);
+        dfd.push_back(0);
+        // sample: bit offset 0, bit length - 1, channel 0 (color) at the block origin over the full range
+        dfd.push_back((bytes * 8 - 1) << 16);
+        dfd.push_back(0);
+        dfd.push_back(0);
+        dfd.push_back(0xFFFFFFFF);
+        return dfd;
+    }
+}
+
+uint32_t Ktx2File::blockSize(VkFormat format) {
+    switch (format) {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        return 8;
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+bool Ktx2File::open(const std::string& path) {
+    close();
+
+    if (!_file.open(path) || _file.Size < sizeof(Ktx2Header)) {
+        close();
+        return false;
+    }
+
+    Ktx2Header header;
+    memcpy(&header, _file.Data, sizeof(header));
+
+    bool valid = memcmp(header.Identifier, ktx2Identifier, sizeof(ktx2Identifier)) == 0 &&
+        blockSize(static_cast<VkFormat>(header.VkFormat)) != 0 &&
+        header.PixelWidth > 0 && header.PixelHeight > 0 && header.PixelDepth == 0 &&
+        header.LayerCount <= 1 && header.FaceCount == 1 &&
+        header.LevelCount > 0 && header.LevelCount <= maxLevels && header.SupercompressionScheme == 0 &&
+        sizeof(header) + header.LevelCount * sizeof(Ktx2LevelIndex) <= _file.Size;
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header.LevelCount; i++) {
+        Ktx2LevelIndex index;
+        memcpy(&index, _file.Data + sizeof(header) + i * sizeof(index), sizeof(index));
+
+        uint64_t blocksWide = (std::max(header.PixelWidth >> i, 1u) + 3) / 4;
+        uint64_t blocksHigh = (std::max(header.PixelHeight >> i, 1u) + 3) / 4;
+        // checked so a corrupt offset can't wrap around past the end of the mapping
+        bool inFile = index.ByteOffset <= _file.Size && index.ByteLength <= _file.Size - index.ByteOffset;
+        if (!inFile || index.ByteLength != blocksWide * blocksHigh * blockSize(static_cast<VkFormat>(header.VkFormat))) {
+            close();
+            return false;
+        }
+        Levels.push_back({_file.Data + index.ByteOffset, index.ByteLength});
+    }
+
+    Format = static_cast<VkFormat>(header.VkFormat);
+    Width = header.PixelWidth;
+    Height = header.PixelHeight;
+    return true;
+}
+
+void Ktx2File::close() {
+    _file.close();
+    Format = VK_FORMAT_UNDEFINED;
+    Width = 0;
+    Height = 0;
+    Levels.clear();
+}
+
+bool Ktx2File::write(const std::string& path, VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels) {
+    if (blockSize(format) == 0 || levels.empty()) {
+        return false;
+    }
+
+    auto dfd = dataFormatDescriptor(format);
+    auto levelCount = static_cast<uint32_t>(levels.size());
+
+    Ktx2Header header = {};
+    memcpy(header.Identifier, ktx2Identifier, sizeof(ktx2Identifier));
+    header.VkFormat = format;
+    // block-compressed formats always have a type size of 1
+    header.TypeSize = 1;
+    header.PixelWidth = width;
+    header.PixelHeight = height;
+    header.FaceCount = 1;
+    header.LevelCount = levelCount;
+    header.DfdByteOffset = static_cast<uint32_t>(sizeof(header) + levelCount * sizeof(Ktx2LevelIndex));
+    header.DfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+    // the spec stores the smallest level first, each aligned to lcm(block size, 4)
+    std::vector<Ktx2LevelIndex> index(levelCount);
+    uint64_t offset = header.DfdByteOffset + header.DfdByteLength;
+    for (uint32_t i = levelCount; i-- > 0;) {
+        offset = alignOffset(offset, blockSize(format));
+        index[i].ByteOffset = offset;
+        index[i].ByteLength = levels[i].size();
+        index[i].UncompressedByteLength = levels[i].size();
+        offset += levels[i].size();
+    }
+
+    std::vector<FileSpan> spans = {
+        {0, &header, sizeof(header)},
+        {sizeof(header), index.data(), index.size() * sizeof(Ktx2LevelIndex)},
+        {header.DfdByteOffset, dfd.data(), header.DfdByteLength},
+    };
+    for (uint32_t i = levelCount; i-- > 0;) {
+        spans.push_back({index[i].ByteOffset, levels[i].data(), levels[i].size()});
+    }
+    return writeFileAtomic(path, spans);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A single 2D texture in a KTX2 container: one layer, one face, no
+// supercompression, every mip level stored as-is. open() maps the file, so
+// the levels can be copied straight into a staging buffer.
+//
+// Only the block-compressed formats the texture compiler writes are
+// supported, which keeps the data format descriptor to one fixed sample.
+class Ktx2File {
+public:
+    struct Level {
+        const char* Data;
+        uint64_t Size;
+    };
+
+    VkFormat Format = VK_FORMAT_UNDEFINED;
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    // level 0 is the full size image
+    std::vector<Level> Levels;
+
+    // fails if the file is missing, not KTX2, or uses anything beyond the above
+    bool open(const std::string& path);
+    void close();
+
+    // levels[i] holds the blocks of mip level i
+    static bool write(const std::string& path, VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels);
+
+    // bytes per 4x4 block, 0 for formats this class does not handle
+    static uint32_t blockSize(VkFormat format);
+
+private:
+    MappedFile _file;
+};
@@ -0,0 +1,177 @@
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (_file == INVALID_HANDLE_VALUE) {
+        _file = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(_file, &size) || size.QuadPart == 0) {
+        close();
+        return false;
+    }
+
+    _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (_mapping == nullptr) {
+        close();
+        return false;
+    }
+
+    Data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (Data == nullptr) {
+        close();
+        return false;
+    }
+    Size = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if (Data)
+        UnmapViewOfFile(Data);
+    if (_mapping)
+        CloseHandle(_mapping);
+    if (_file)
+        CloseHandle(_file);
+    Data = nullptr;
+    Size = 0;
+    _mapping = nullptr;
+    _file = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string& path) {
+    close();
+
+    _fd = ::open(path.c_str(), O_RDONLY);
+    if (_fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(_fd, &st) != 0 || st.st_size == 0) {
+        close();
+        return false;
+    }
+
+    void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, _fd, 0);
+    if (data == MAP_FAILED) {
+        close();
+        return false;
+    }
+    // the whole file is about to be streamed into a staging buffer
+    madvise(data, static_cast<size_t>(st.st_size), MADV_WILLNEED);
+
+    Data = static_cast<const char*>(data);
+    Size = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (Data)
+        munmap(const_cast<char*>(Data), Size);
+    if (_fd >= 0)
+        ::close(_fd);
+    Data = nullptr;
+    Size = 0;
+    _fd = -1;
+}
+
+#endif
+
+uint64_t hashFile(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return 0;
+    }
+
+    // FNV-1a over 8 byte words, the tail is folded in byte by byte
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL ^ file.Size;
+
+    size_t words = file.Size / 8;
+    for (size_t i = 0; i < words; i++) {
+        uint64_t word;
+        memcpy(&word, file.Data + i * 8, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+    for (size_t i = words * 8; i < file.Size; i++) {
+        hash = (hash ^ static_cast<unsigned char>(file.Data[i])) * prime;
+    }
+
+    return hash;
+}
+
+bool writeFileAtomic(const std::string& path, const std::vector<FileSpan>& spans) {
+    const char padding[64] = {};
+
+    // unique per process, so two instances refreshing the same cache don't write into one file
+#ifdef _WIN32
+    auto tmpPath = path + "." + std::to_string(GetCurrentProcessId()) + ".tmp";
+#else
+    auto tmpPath = path + "." + std::to_string(getpid()) + ".tmp";
+#endif
+    bool written = false;
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+
+        uint64_t offset = 0;
+        bool sorted = true;
+        for (const auto& span : spans) {
+            if (span.Offset < offset) {
+                sorted = false;
+                break;
+            }
+            while (offset < span.Offset) {
+                auto gap = std::min<uint64_t>(span.Offset - offset, sizeof(padding));
+                file.write(padding, static_cast<std::streamsize>(gap));
+                offset += gap;
+            }
+            file.write(static_cast<const char*>(span.Data), static_cast<std::streamsize>(span.Size));
+            offset += span.Size;
+        }
+        file.close();
+        written = sorted && file;
+    }
+
+#ifdef _WIN32
+    bool renamed = written && MoveFileExA(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    bool renamed = written && std::rename(tmpPath.c_str(), path.c_str()) == 0;
+#endif
+    if (!renamed) {
+        std::remove(tmpPath.c_str());
+    }
+    return renamed;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    const char* Data = nullptr;
+    size_t Size = 0;
+
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // returns false if the file does not exist or cannot be mapped
+    bool open(const std::string& path);
+    void close();
+
+private:
+#ifdef _WIN32
+    void* _file = nullptr;
+    void* _mapping = nullptr;
+#else
+    int _fd = -1;
+#endif
+};
+
+// Fast non-cryptographic hash of a file's contents, for tagging caches with
+// the source they were built from. 0 if the file cannot be read.
+uint64_t hashFile(const std::string& path);
+
+// offset rounded up to the next multiple of alignment, for laying out files that get mapped
+inline uint64_t alignOffset(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// a piece of a file being written, Size bytes at Offset
+struct FileSpan {
+    uint64_t Offset;
+    const void* Data;
+    uint64_t Size;
+};
+
+// Writes spans sorted by offset, zero filling the gaps between them. The file
+// is written under a temporary name and renamed over path, so a half-written
+// file is never picked up by a later open(). On failure the temporary file is
+// removed and path is left as it was.
+bool writeFileAtomic(const std::string& path, const std::vector<FileSpan>& spans);
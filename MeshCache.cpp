@@ -0,0 +1,89 @@
+#include "MeshCache.h"
+
+#include <cstring>
+
+namespace {
+    const uint32_t meshCacheMagic = 0x4d535456; // "VTSM"
+    // 2: meshes are stored after MeshOptimizer reordering
+    const uint32_t meshCacheVersion = 2;
+
+    struct MeshCacheHeader {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t VertexSize;
+        uint32_t Reserved;
+        uint64_t SourceHash;
+        uint64_t VertexCount;
+        uint64_t IndexCount;
+        // both arrays start on a 16 byte boundary
+        uint64_t VertexOffset;
+        uint64_t IndexOffset;
+    };
+}
+
+bool MeshCache::open(const std::string& path, uint64_t sourceHash, uint32_t vertexSize) {
+    close();
+
+    if (!_file.open(path) || _file.Size < sizeof(MeshCacheHeader)) {
+        close();
+        return false;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, _file.Data, sizeof(header));
+
+    bool valid = header.Magic == meshCacheMagic &&
+        header.Version == meshCacheVersion &&
+        header.VertexSize == vertexSize &&
+        header.SourceHash == sourceHash &&
+        vertexSize > 0 &&
+        // compared as counts so a corrupt header can't overflow past the checks
+        header.VertexOffset <= _file.Size && header.VertexCount <= (_file.Size - header.VertexOffset) / vertexSize &&
+        header.IndexOffset % sizeof(uint32_t) == 0 &&
+        header.IndexOffset <= _file.Size && header.IndexCount <= (_file.Size - header.IndexOffset) / sizeof(uint32_t);
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    // an index past the vertices would go straight into the index buffer, one pass is cheap next to parsing
+    auto indices = reinterpret_cast<const uint32_t*>(_file.Data + header.IndexOffset);
+    for (uint64_t i = 0; i < header.IndexCount; i++) {
+        if (indices[i] >= header.VertexCount) {
+            close();
+            return false;
+        }
+    }
+
+    Vertices = _file.Data + header.VertexOffset;
+    VertexCount = header.VertexCount;
+    Indices = indices;
+    IndexCount = header.IndexCount;
+    return true;
+}
+
+void MeshCache::close() {
+    _file.close();
+    Vertices = nullptr;
+    VertexCount = 0;
+    Indices = nullptr;
+    IndexCount = 0;
+}
+
+bool MeshCache::write(const std::string& path, uint64_t sourceHash, uint32_t vertexSize, const void* vertices, uint64_t vertexCount, const uint32_t* indices, uint64_t indexCount) {
+    MeshCacheHeader header = {};
+    header.Magic = meshCacheMagic;
+    header.Version = meshCacheVersion;
+    header.VertexSize = vertexSize;
+    header.SourceHash = sourceHash;
+    header.VertexCount = vertexCount;
+    header.IndexCount = indexCount;
+    header.VertexOffset = alignOffset(sizeof(header), 16);
+    header.IndexOffset = alignOffset(header.VertexOffset + vertexCount * vertexSize, 16);
+
+    return writeFileAtomic(path, {
+        {0, &header, sizeof(header)},
+        {header.VertexOffset, vertices, vertexCount * vertexSize},
+        {header.IndexOffset, indices, indexCount * sizeof(uint32_t)},
+    });
+}
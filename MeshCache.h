@@ -0,0 +1,28 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+
+// Versioned binary dump of a loaded mesh: the final deduplicated vertex and
+// index arrays, tagged with a hash of the source file they came from.
+// open() maps the file, so the arrays can be copied straight into a staging
+// buffer without any parsing.
+class MeshCache {
+public:
+    const void* Vertices = nullptr;
+    uint64_t VertexCount = 0;
+    const uint32_t* Indices = nullptr;
+    uint64_t IndexCount = 0;
+
+    // fails if the file is missing, from another format version, built from a different source,
+    // or inconsistent: arrays outside the file or indices past the vertices
+    bool open(const std::string& path, uint64_t sourceHash, uint32_t vertexSize);
+    void close();
+
+    static bool write(const std::string& path, uint64_t sourceHash, uint32_t vertexSize, const void* vertices, uint64_t vertexCount, const uint32_t* indices, uint64_t indexCount);
+
+private:
+    MappedFile _file;
+};
@@ -0,0 +1,263 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+namespace {
+    const uint32_t noVertex = UINT32_MAX;
+
+    // FIFO post-transform cache, tracked through the time each vertex entered it
+    class CacheSimulator {
+    public:
+        explicit CacheSimulator(size_t vertexCount)
+            : _entered(vertexCount, 0) {
+        }
+
+        // returns the number of vertices that had to be transformed
+        uint32_t triangle(const uint32_t* corners) {
+            uint32_t misses = 0;
+            for (int k = 0; k < 3; k++) {
+                if (_time - _entered[corners[k]] > MeshOptimizer::CacheSize) {
+                    _entered[corners[k]] = _time++;
+                    misses++;
+                }
+            }
+            return misses;
+        }
+
+        void flush() {
+            _time += MeshOptimizer::CacheSize + 1;
+        }
+
+    private:
+        std::vector<uint32_t> _entered;
+        uint32_t _time = MeshOptimizer::CacheSize + 1;
+    };
+}
+
+MeshOptimizeStats MeshOptimizer::optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    MeshOptimizeStats stats = {};
+    stats.Before = analyzeVertexCache(indices, vertices.size());
+
+    std::vector<uint32_t> clusters;
+    optimizeVertexCache(indices, vertices.size(), clusters);
+    stats.Clusters = optimizeOverdraw(indices, vertices, clusters);
+    optimizeVertexFetch(vertices, indices);
+
+    stats.After = analyzeVertexCache(indices, vertices.size());
+
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    stats.Seconds = std::chrono::duration<double, std::chrono::seconds::period>(currentTime - startTime).count();
+    return stats;
+}
+
+VertexCacheStats MeshOptimizer::analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount) {
+    CacheSimulator cache(vertexCount);
+    size_t misses = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        misses += cache.triangle(&indices[i]);
+    }
+
+    VertexCacheStats stats = {};
+    stats.Acmr = indices.size() >= 3 ? static_cast<float>(misses) / static_cast<float>(indices.size() / 3) : 0.0f;
+    stats.Atvr = vertexCount > 0 ? static_cast<float>(misses) / static_cast<float>(vertexCount) : 0.0f;
+    return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& clusters) {
+    size_t triangleCount = indices.size() / 3;
+    clusters.clear();
+    if (triangleCount == 0)
+        return;
+
+    // triangles around each vertex, packed
+    std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        adjacencyStart[indices[i] + 1]++;
+    }
+    std::partial_sum(adjacencyStart.begin(), adjacencyStart.end(), adjacencyStart.begin());
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // triangles around each vertex not emitted yet
+    std::vector<uint32_t> live(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        live[v] = adjacencyStart[v + 1] - adjacencyStart[v];
+    }
+
+    std::vector<uint32_t> entered(vertexCount, 0);
+    uint32_t time = CacheSize + 1;
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    size_t cursor = 0;
+
+    clusters.push_back(0);
+    auto fanning = indices[0];
+    while (fanning != noVertex) {
+        // emit the whole fan around the current vertex
+        candidates.clear();
+        for (auto a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++) {
+            auto triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+
+            for (int k = 0; k < 3; k++) {
+                auto v = indices[3 * triangle + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (time - entered[v] > CacheSize)
+                    entered[v] = time++;
+            }
+            emitted[triangle] = true;
+        }
+
+        // oldest candidate that will still be cached after its own fan is emitted
+        auto next = noVertex;
+        int64_t best = -1;
+        for (auto v : candidates) {
+            if (live[v] == 0)
+                continue;
+            int64_t priority = 0;
+            if (time - entered[v] + 2 * live[v] <= CacheSize)
+                priority = time - entered[v];
+            if (priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+
+        if (next == noVertex) {
+            // dead end: back up to a recently emitted vertex, or scan for any left
+            while (!deadEnd.empty() && next == noVertex) {
+                auto v = deadEnd.back();
+                deadEnd.pop_back();
+                if (live[v] > 0)
+                    next = v;
+            }
+            while (next == noVertex && cursor < vertexCount) {
+                if (live[cursor] > 0)
+                    next = static_cast<uint32_t>(cursor);
+                else
+                    cursor++;
+            }
+            if (next != noVertex)
+                clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+        }
+
+        fanning = next;
+    }
+
+    indices.swap(output);
+}
+
+size_t MeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusters, float threshold) {
+    auto triangleCount = static_cast<uint32_t>(indices.size() / 3);
+    if (triangleCount == 0)
+        return 0;
+
+    // split each cluster wherever the part so far is already as cache friendly as the whole
+    std::vector<uint32_t> starts;
+    CacheSimulator cache(vertices.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        auto begin = clusters[c];
+        auto end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+        cache.flush();
+        uint32_t clusterMisses = 0;
+        for (auto t = begin; t < end; t++) {
+            clusterMisses += cache.triangle(&indices[3 * t]);
+        }
+        float limit = threshold * clusterMisses / (end - begin);
+
+        cache.flush();
+        starts.push_back(begin);
+        uint32_t misses = 0;
+        uint32_t start = begin;
+        for (auto t = begin; t < end; t++) {
+            misses += cache.triangle(&indices[3 * t]);
+            if (t + 1 < end && static_cast<float>(misses) / (t + 1 - start) <= limit) {
+                starts.push_back(t + 1);
+                start = t + 1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+    }
+    starts.push_back(triangleCount);
+    auto clusterCount = starts.size() - 1;
+
+    // clusters facing away from the middle of the mesh are likely to occlude the rest
+    auto trianglePosition = [&](uint32_t t, int k) { return vertices[indices[3 * t + k]].pos; };
+
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        auto p0 = trianglePosition(t, 0), p1 = trianglePosition(t, 1), p2 = trianglePosition(t, 2);
+        auto area = glm::length(glm::cross(p1 - p0, p2 - p0));
+        meshCentroid += (p0 + p1 + p2) * (area / 3.0f);
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    std::vector<float> sortKeys(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        glm::vec3 centroid(0.0f);
+        glm::vec3 normal(0.0f);
+        float area = 0.0f;
+        for (auto t = starts[c]; t < starts[c + 1]; t++) {
+            auto p0 = trianglePosition(t, 0), p1 = trianglePosition(t, 1), p2 = trianglePosition(t, 2);
+            auto n = glm::cross(p1 - p0, p2 - p0);
+            auto a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+        auto normalLength = glm::length(normal);
+        if (area > 0.0f && normalLength > 0.0f)
+            sortKeys[c] = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+        else
+            sortKeys[c] = 0.0f;
+    }
+
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (auto c : order) {
+        output.insert(output.end(), indices.begin() + 3 * starts[c], indices.begin() + 3 * starts[c + 1]);
+    }
+    indices.swap(output);
+
+    return clusterCount;
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    std::vector<uint32_t> remap(vertices.size(), noVertex);
+    std::vector<Vertex> ordered;
+    ordered.reserve(vertices.size());
+
+    for (auto& index : indices) {
+        if (remap[index] == noVertex) {
+            remap[index] = static_cast<uint32_t>(ordered.size());
+            ordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(ordered);
+}
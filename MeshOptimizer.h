@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Vertex.h"
+
+#include <cstdint>
+#include <vector>
+
+struct VertexCacheStats {
+    // vertex shader invocations per triangle, 0.5 at best and 3 at worst
+    float Acmr;
+    // vertex shader invocations per unique vertex, 1 at best
+    float Atvr;
+};
+
+struct MeshOptimizeStats {
+    VertexCacheStats Before;
+    VertexCacheStats After;
+    size_t Clusters;
+    double Seconds;
+};
+
+// Reorders a deduplicated triangle list for the GPU, in the spirit of
+// Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw": Tipsify for post-transform cache reuse, cluster sorting for
+// overdraw, then vertices renumbered in the order they are first fetched.
+class MeshOptimizer {
+public:
+    // FIFO size the reordering and the statistics assume
+    static const uint32_t CacheSize = 16;
+
+    // runs all the passes below in order
+    static MeshOptimizeStats optimize(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+    static VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount);
+
+    // Tipsify; clusters receives the first triangle of each run that had to restart from a dead end
+    static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& clusters);
+
+    // splits clusters further while their ACMR stays within threshold of the
+    // unsplit one, then draws outward-facing clusters first; returns the cluster count
+    static size_t optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& clusters, float threshold = 1.05f);
+
+    // renumbers vertices in first-use order so fetches walk the vertex buffer forwards
+    static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+};
@@ -0,0 +1,188 @@
+#include "MipChain.h"
+
+#include "CpuFeatures.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+    struct SrgbTables {
+        uint16_t ToLinear[256];
+        // indexed by 16 bit linear value, big enough that rounding near black stays exact
+        uint8_t FromLinear[65536];
+    };
+
+    const SrgbTables& srgbTables() {
+        static const SrgbTables* tables = [] {
+            auto t = new SrgbTables();
+            for (int i = 0; i < 256; i++) {
+                double v = i / 255.0;
+                double linear = v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+                t->ToLinear[i] = static_cast<uint16_t>(linear * 65535.0 + 0.5);
+            }
+            for (int i = 0; i < 65536; i++) {
+                double linear = i / 65535.0;
+                double v = linear <= 0.0031308 ? linear * 12.92 : 1.055 * std::pow(linear, 1.0 / 2.4) - 0.055;
+                t->FromLinear[i] = static_cast<uint8_t>(std::min(std::max(v, 0.0), 1.0) * 255.0 + 0.5);
+            }
+            return t;
+        }();
+        return *tables;
+    }
+
+    // alpha is stored as a * 257, which maps 255 to 65535 like the color channels
+    void toLinear(const uint8_t* rgba, size_t texels, uint16_t* linear) {
+        auto& tables = srgbTables();
+        for (size_t i = 0; i < texels; i++) {
+            linear[i * 4 + 0] = tables.ToLinear[rgba[i * 4 + 0]];
+            linear[i * 4 + 1] = tables.ToLinear[rgba[i * 4 + 1]];
+            linear[i * 4 + 2] = tables.ToLinear[rgba[i * 4 + 2]];
+            linear[i * 4 + 3] = static_cast<uint16_t>(rgba[i * 4 + 3] * 257);
+        }
+    }
+
+    void fromLinear(const uint16_t* linear, size_t texels, uint8_t* rgba) {
+        auto& tables = srgbTables();
+        for (size_t i = 0; i < texels; i++) {
+            rgba[i * 4 + 0] = tables.FromLinear[linear[i * 4 + 0]];
+            rgba[i * 4 + 1] = tables.FromLinear[linear[i * 4 + 1]];
+            rgba[i * 4 + 2] = tables.FromLinear[linear[i * 4 + 2]];
+            rgba[i * 4 + 3] = static_cast<uint8_t>((linear[i * 4 + 3] * 255u + 32767u) / 65535u);
+        }
+    }
+
+#ifdef CPU_X86
+    // each filters output texels from x on and returns where it stopped, the next path picks up the rest
+    CPU_TARGET("avx2") uint32_t downsampleRowAvx2(const uint16_t* row0, const uint16_t* row1, uint16_t* out, uint32_t x, uint32_t dstWidth) {
+        // four output texels: each 128 bit lane holds the two source texels of one of them
+        const __m256i round2 = _mm256_set1_epi32(2);
+        for (; x + 4 <= dstWidth; x += 4) {
+            __m256i sums[2];
+            for (int half = 0; half < 2; half++) {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + (x + half * 2) * 8));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + (x + half * 2) * 8));
+                __m256i zero = _mm256_setzero_si256();
+                __m256i sum = _mm256_add_epi32(_mm256_unpacklo_epi16(a, zero), _mm256_unpackhi_epi16(a, zero));
+                sum = _mm256_add_epi32(sum, _mm256_add_epi32(_mm256_unpacklo_epi16(b, zero), _mm256_unpackhi_epi16(b, zero)));
+                sums[half] = _mm256_srli_epi32(_mm256_add_epi32(sum, round2), 2);
+            }
+            // the pack works per lane and leaves the texels in x, x+2, x+1, x+3 order
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(sums[0], sums[1]), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x * 4), packed);
+        }
+        return x;
+    }
+
+    uint32_t downsampleRowSse2(const uint16_t* row0, const uint16_t* row1, uint16_t* out, uint32_t x, uint32_t dstWidth) {
+        // two output texels, SSE2 has no unsigned 32 to 16 bit pack so the sums are biased into signed range
+        const __m128i round = _mm_set1_epi32(2);
+        const __m128i bias32 = _mm_set1_epi32(32768);
+        const __m128i bias16 = _mm_set1_epi16(-32768);
+        for (; x + 2 <= dstWidth; x += 2) {
+            __m128i sums[2];
+            for (int half = 0; half < 2; half++) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + (x + half) * 8));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + (x + half) * 8));
+                __m128i zero = _mm_setzero_si128();
+                __m128i sum = _mm_add_epi32(_mm_unpacklo_epi16(a, zero), _mm_unpackhi_epi16(a, zero));
+                sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_unpacklo_epi16(b, zero), _mm_unpackhi_epi16(b, zero)));
+                sums[half] = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(sum, round), 2), bias32);
+            }
+            __m128i packed = _mm_xor_si128(_mm_packs_epi32(sums[0], sums[1]), bias16);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), packed);
+        }
+        return x;
+    }
+#endif
+}
+
+uint32_t MipChain::levelCount(uint32_t width, uint32_t height) {
+    return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+}
+
+void MipChain::downsampleScalar(const uint16_t* src, uint32_t width, uint32_t height, uint16_t* dst, uint32_t rowBegin, uint32_t rowEnd) {
+    uint32_t dstWidth = std::max(width / 2, 1u);
+    for (uint32_t y = rowBegin; y < rowEnd; y++) {
+        const uint16_t* row0 = src + static_cast<size_t>(std::min(y * 2, height - 1)) * width * 4;
+        const uint16_t* row1 = src + static_cast<size_t>(std::min(y * 2 + 1, height - 1)) * width * 4;
+        uint16_t* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+        for (uint32_t x = 0; x < dstWidth; x++) {
+            uint32_t x0 = std::min(x * 2, width - 1) * 4;
+            uint32_t x1 = std::min(x * 2 + 1, width - 1) * 4;
+            for (uint32_t c = 0; c < 4; c++) {
+                out[x * 4 + c] = static_cast<uint16_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+            }
+        }
+    }
+}
+
+void MipChain::downsample(const uint16_t* src, uint32_t width, uint32_t height, uint16_t* dst, uint32_t rowBegin, uint32_t rowEnd) {
+    // a 1 texel wide or high level reuses its last column or row, which only the scalar path handles
+    if (width < 2 || height < 2) {
+        downsampleScalar(src, width, height, dst, rowBegin, rowEnd);
+        return;
+    }
+
+    uint32_t dstWidth = width / 2;
+#ifdef CPU_X86
+    bool avx2 = CpuFeatures::get().Avx2;
+#endif
+    for (uint32_t y = rowBegin; y < rowEnd; y++) {
+        const uint16_t* row0 = src + static_cast<size_t>(y * 2) * width * 4;
+        const uint16_t* row1 = row0 + static_cast<size_t>(width) * 4;
+        uint16_t* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+        uint32_t x = 0;
+
+#ifdef CPU_X86
+        if (avx2)
+            x = downsampleRowAvx2(row0, row1, out, x, dstWidth);
+        x = downsampleRowSse2(row0, row1, out, x, dstWidth);
+#endif
+
+        for (; x < dstWidth; x++) {
+            for (uint32_t c = 0; c < 4; c++) {
+                out[x * 4 + c] = static_cast<uint16_t>((row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c] + 2) >> 2);
+            }
+        }
+    }
+}
+
+std::vector<MipLevel> MipChain::build(const uint8_t* rgba, uint32_t width, uint32_t height, unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    std::vector<MipLevel> levels(levelCount(width, height));
+    levels[0] = {width, height, std::vector<uint8_t>(rgba, rgba + static_cast<size_t>(width) * height * 4)};
+
+    std::vector<uint16_t> linear(static_cast<size_t>(width) * height * 4);
+    parallelFor(height, threads, [&](size_t begin, size_t end, unsigned) {
+        toLinear(rgba + begin * width * 4, (end - begin) * width, linear.data() + begin * width * 4);
+    });
+
+    std::vector<uint16_t> next;
+    for (size_t i = 1; i < levels.size(); i++) {
+        uint32_t levelWidth = std::max(width >> i, 1u);
+        uint32_t levelHeight = std::max(height >> i, 1u);
+        uint32_t srcWidth = levels[i - 1].Width;
+        uint32_t srcHeight = levels[i - 1].Height;
+        next.resize(static_cast<size_t>(levelWidth) * levelHeight * 4);
+        levels[i] = {levelWidth, levelHeight, std::vector<uint8_t>(next.size())};
+
+        // small levels aren't worth a thread each
+        unsigned levelThreads = std::min(threads, levelHeight / 32 + 1);
+        parallelFor(levelHeight, levelThreads, [&](size_t begin, size_t end, unsigned) {
+            downsample(linear.data(), srcWidth, srcHeight, next.data(), static_cast<uint32_t>(begin), static_cast<uint32_t>(end));
+            fromLinear(next.data() + begin * levelWidth * 4, (end - begin) * levelWidth, levels[i].Data.data() + begin * levelWidth * 4);
+        });
+        linear.swap(next);
+    }
+
+    return levels;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct MipLevel {
+    uint32_t Width;
+    uint32_t Height;
+    // RGBA8, sRGB color and linear alpha, rows tightly packed
+    std::vector<uint8_t> Data;
+};
+
+// Builds a full mip chain on the CPU with a 2x2 box filter.
+//
+// Color is averaged in linear light: every level is filtered from the level
+// above it kept as 16 bit linear values, and only rounded to sRGB bytes on
+// the way out, so errors don't pile up down the chain. The filter itself is
+// SSE2 on x86-64, AVX2 when the CPU has it, with a scalar fallback. Odd
+// sizes drop their last row or column like vkCmdBlitImage does.
+class MipChain {
+public:
+    // level 0 is a copy of rgba, the last level is 1x1
+    static std::vector<MipLevel> build(const uint8_t* rgba, uint32_t width, uint32_t height, unsigned threads = 0);
+
+    static uint32_t levelCount(uint32_t width, uint32_t height);
+
+    // one level of 16 bit linear RGBA into the next, rows [rowBegin, rowEnd) of dst
+    static void downsample(const uint16_t* src, uint32_t width, uint32_t height, uint16_t* dst, uint32_t rowBegin, uint32_t rowEnd);
+    // the same without SIMD, the reference the vector paths have to match bit for bit
+    static void downsampleScalar(const uint16_t* src, uint32_t width, uint32_t height, uint16_t* dst, uint32_t rowBegin, uint32_t rowEnd);
+};
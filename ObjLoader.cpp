@@ -0,0 +1,231 @@
+#include "ObjLoader.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+#include "VertexDedup.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tinyobjloader/tiny_obj_loader.h>
+
+namespace {
+    struct ObjChunk {
+        std::vector<float> Positions;
+        std::vector<float> TexCoords;
+        // zero-based (position, texcoord) pairs, three per triangle
+        std::vector<uint32_t> Corners;
+        bool Supported = true;
+    };
+
+    bool isSpace(char c) {
+        return c == ' ' || c == '\t';
+    }
+
+    // Mirrors what tinyobj does per line, including its float parser, so the
+    // parsed values are bit-identical. Lines are copied out first because
+    // tinyobj's helpers expect null-terminated input.
+    void parseChunk(const char* begin, const char* end, ObjChunk& chunk) {
+        std::string line;
+        const char* p = begin;
+        while (p < end && chunk.Supported) {
+            auto lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+            if (!lineEnd)
+                lineEnd = end;
+
+            auto first = p;
+            while (first < lineEnd && isSpace(*first))
+                first++;
+            p = lineEnd + 1;
+
+            // only v, vt and f lines matter for the mesh
+            if (first == lineEnd || (*first != 'v' && *first != 'f'))
+                continue;
+
+            line.assign(first, lineEnd);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            // tinyobj also breaks lines on a lone carriage return
+            if (line.find('\r') != std::string::npos) {
+                chunk.Supported = false;
+                break;
+            }
+
+            const char* token = line.c_str();
+
+            if (token[0] == 'v' && isSpace(token[1])) {
+                token += 2;
+                chunk.Positions.push_back(tinyobj::parseReal(&token));
+                chunk.Positions.push_back(tinyobj::parseReal(&token));
+                chunk.Positions.push_back(tinyobj::parseReal(&token));
+            } else if (token[0] == 'v' && token[1] == 't' && isSpace(token[2])) {
+                token += 3;
+                chunk.TexCoords.push_back(tinyobj::parseReal(&token));
+                chunk.TexCoords.push_back(tinyobj::parseReal(&token));
+            } else if (token[0] == 'f' && isSpace(token[1])) {
+                token += 2;
+                token += strspn(token, " \t");
+
+                int count = 0;
+                while (token[0] != '\0') {
+                    int v = atoi(token);
+                    int vt = 0;
+                    token += strcspn(token, "/ \t\r");
+                    if (token[0] == '/') {
+                        token++;
+                        // v//vn has no texture coordinate
+                        if (token[0] != '/') {
+                            vt = atoi(token);
+                            token += strcspn(token, "/ \t\r");
+                        }
+                        if (token[0] == '/') {
+                            token++;
+                            token += strcspn(token, "/ \t\r");
+                        }
+                    }
+
+                    // relative, missing or zero indices are left to tinyobj
+                    if (v <= 0 || vt <= 0) {
+                        chunk.Supported = false;
+                        break;
+                    }
+                    chunk.Corners.push_back(static_cast<uint32_t>(v - 1));
+                    chunk.Corners.push_back(static_cast<uint32_t>(vt - 1));
+                    count++;
+
+                    token += strspn(token, " \t\r");
+                }
+
+                // polygons would need tinyobj's triangulation
+                if (count != 3)
+                    chunk.Supported = false;
+            }
+        }
+    }
+}
+
+ObjLoadStats ObjLoader::load(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    ObjLoadStats stats = {};
+    stats.Threads = std::max(std::thread::hardware_concurrency(), 1u);
+    stats.Parallel = loadParallel(path, vertices, indices, stats.Threads);
+    if (!stats.Parallel) {
+        stats.Threads = 1;
+        loadSequential(path, vertices, indices);
+    }
+
+    auto currentTime = std::chrono::high_resolution_clock::now();
+    stats.Seconds = std::chrono::duration<double, std::chrono::seconds::period>(currentTime - startTime).count();
+
+    MappedFile file;
+    stats.Bytes = file.open(path) ? file.Size : 0;
+    stats.Triangles = indices.size() / 3;
+    return stats;
+}
+
+void ObjLoader::loadSequential(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str())) {
+        throw std::runtime_error(warn + err);
+    }
+
+    size_t indexCount = 0;
+    for (const auto& shape : shapes) {
+        indexCount += shape.mesh.indices.size();
+    }
+
+    VertexDedup uniqueVertices(indexCount);
+
+    for (const auto& shape : shapes) {
+	    for (const auto& index : shape.mesh.indices) {
+			Vertex vertex = {};
+            vertex.pos = {
+				attrib.vertices[3 * index.vertex_index + 0],
+				attrib.vertices[3 * index.vertex_index + 1],
+				attrib.vertices[3 * index.vertex_index + 2]
+			};
+
+			vertex.texCoord = {
+				attrib.texcoords[2 * index.texcoord_index + 0],
+				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+			};
+
+            vertex.color = {1.0f, 1.0f, 1.0f};
+
+			indices.push_back(uniqueVertices.insert(vertex));
+		}
+	}
+
+    vertices = std::move(uniqueVertices.Vertices);
+}
+
+bool ObjLoader::loadParallel(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, unsigned threads) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+
+    // line-aligned chunks, one per thread
+    std::vector<const char*> bounds = {file.Data};
+    for (unsigned t = 1; t < threads; t++) {
+        auto split = std::max(file.Data + file.Size * t / threads, bounds.back());
+        auto newline = static_cast<const char*>(memchr(split, '\n', file.Data + file.Size - split));
+        bounds.push_back(newline ? newline + 1 : file.Data + file.Size);
+    }
+    bounds.push_back(file.Data + file.Size);
+
+    std::vector<ObjChunk> chunks(threads);
+    parallelFor(threads, threads, [&](size_t begin, size_t end, unsigned) {
+        for (size_t c = begin; c < end; c++) {
+            parseChunk(bounds[c], bounds[c + 1], chunks[c]);
+        }
+    });
+
+    // stitch the chunks together in file order
+    std::vector<float> positions;
+    std::vector<float> texCoords;
+    std::vector<uint32_t> corners;
+    for (const auto& chunk : chunks) {
+        if (!chunk.Supported)
+            return false;
+        positions.insert(positions.end(), chunk.Positions.begin(), chunk.Positions.end());
+        texCoords.insert(texCoords.end(), chunk.TexCoords.begin(), chunk.TexCoords.end());
+        corners.insert(corners.end(), chunk.Corners.begin(), chunk.Corners.end());
+    }
+    chunks.clear();
+
+    size_t cornerCount = corners.size() / 2;
+    size_t positionCount = positions.size() / 3;
+    size_t texCoordCount = texCoords.size() / 2;
+    for (size_t i = 0; i < cornerCount; i++) {
+        if (corners[2 * i] >= positionCount || corners[2 * i + 1] >= texCoordCount)
+            return false;
+    }
+
+    // same construction as the sequential path
+    std::vector<Vertex> cornerVertices(cornerCount);
+    parallelFor(cornerCount, threads, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; i++) {
+            auto v = corners[2 * i];
+            auto vt = corners[2 * i + 1];
+            Vertex vertex = {};
+            vertex.pos = {positions[3 * v + 0], positions[3 * v + 1], positions[3 * v + 2]};
+            vertex.texCoord = {texCoords[2 * vt + 0], 1.0f - texCoords[2 * vt + 1]};
+            vertex.color = {1.0f, 1.0f, 1.0f};
+            cornerVertices[i] = vertex;
+        }
+    });
+
+    VertexDedup::deduplicateSorted(cornerVertices, vertices, indices, threads);
+
+    return true;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Vertex.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct ObjLoadStats {
+    double Seconds;
+    size_t Bytes;
+    size_t Triangles;
+    unsigned Threads;
+    // false when the file needed the tinyobj fallback
+    bool Parallel;
+
+    double megabytesPerSecond() const { return Seconds > 0.0 ? Bytes / (1024.0 * 1024.0) / Seconds : 0.0; }
+    double trianglesPerSecond() const { return Seconds > 0.0 ? Triangles / Seconds : 0.0; }
+};
+
+// Turns an OBJ file into deduplicated vertex and index arrays.
+//
+// The parallel path splits the file into line-aligned chunks parsed on every
+// core, then builds and deduplicates vertices in parallel. Vertices keep
+// their first-seen order, so the output is bit-identical to the sequential
+// tinyobj path. Files using features the parallel parser does not mirror
+// exactly (polygons, negative or missing indices) go through tinyobj.
+class ObjLoader {
+public:
+    static ObjLoadStats load(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+    // the original single-threaded tinyobj path, kept as fallback and reference
+    static void loadSequential(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+    // returns false, leaving the outputs untouched, if the file needs the tinyobj path
+    static bool loadParallel(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, unsigned threads);
+};
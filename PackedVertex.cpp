@@ -0,0 +1,57 @@
+#include "PackedVertex.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    uint16_t quantizeUnorm16(float value, float minimum, float extent) {
+        if (extent <= 0.0f)
+            return 0;
+        auto normalized = std::min(std::max((value - minimum) / extent, 0.0f), 1.0f);
+        return static_cast<uint16_t>(std::lround(normalized * 65535.0f));
+    }
+}
+
+MeshDecode MeshDecode::identity() {
+    MeshDecode decode;
+    decode.PositionScale = glm::vec4(1.0f, 1.0f, 1.0f, 0.0f);
+    decode.PositionOffset = glm::vec4(0.0f);
+    decode.TexCoordScaleOffset = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+    return decode;
+}
+
+MeshDecode packVertices(const Vertex* vertices, size_t count, PackedVertex* packed) {
+    glm::vec3 minPos(0.0f), maxPos(0.0f);
+    glm::vec2 minTexCoord(0.0f), maxTexCoord(0.0f);
+    for (size_t i = 0; i < count; i++) {
+        const auto& vertex = vertices[i];
+        for (int k = 0; k < 3; k++) {
+            minPos[k] = i == 0 ? vertex.pos[k] : std::min(minPos[k], vertex.pos[k]);
+            maxPos[k] = i == 0 ? vertex.pos[k] : std::max(maxPos[k], vertex.pos[k]);
+        }
+        for (int k = 0; k < 2; k++) {
+            minTexCoord[k] = i == 0 ? vertex.texCoord[k] : std::min(minTexCoord[k], vertex.texCoord[k]);
+            maxTexCoord[k] = i == 0 ? vertex.texCoord[k] : std::max(maxTexCoord[k], vertex.texCoord[k]);
+        }
+    }
+
+    auto posExtent = maxPos - minPos;
+    auto texCoordExtent = maxTexCoord - minTexCoord;
+
+    for (size_t i = 0; i < count; i++) {
+        const auto& vertex = vertices[i];
+        auto& out = packed[i];
+        out.pos.x = quantizeUnorm16(vertex.pos.x, minPos.x, posExtent.x);
+        out.pos.y = quantizeUnorm16(vertex.pos.y, minPos.y, posExtent.y);
+        out.pos.z = quantizeUnorm16(vertex.pos.z, minPos.z, posExtent.z);
+        out.pos.w = 0;
+        out.texCoord.x = quantizeUnorm16(vertex.texCoord.x, minTexCoord.x, texCoordExtent.x);
+        out.texCoord.y = quantizeUnorm16(vertex.texCoord.y, minTexCoord.y, texCoordExtent.y);
+    }
+
+    MeshDecode decode;
+    decode.PositionScale = glm::vec4(posExtent, 0.0f);
+    decode.PositionOffset = glm::vec4(minPos, 0.0f);
+    decode.TexCoordScaleOffset = glm::vec4(texCoordExtent.x, texCoordExtent.y, minTexCoord.x, minTexCoord.y);
+    return decode;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "Vertex.h"
+
+#include <cstddef>
+
+// 12 byte vertex: positions and texture coordinates quantized to 16 bits
+// over the mesh's bounds, with the dead color dropped. The vertex shader
+// decodes it with the mesh's MeshDecode push constants.
+struct PackedVertex {
+    // w is padding, three component 16 bit formats are rarely supported for vertex input
+    Unorm16x4 pos;
+    Unorm16x2 texCoord;
+};
+
+typedef VertexLayout<PackedVertex, VERTEX_MEMBER(PackedVertex, pos), VERTEX_MEMBER(PackedVertex, texCoord)> PackedVertexLayout;
+
+// layout a mesh's vertex buffer is uploaded in
+enum class VertexFormat {
+    Float,  // 32 byte Vertex as loaded
+    Packed  // 12 byte PackedVertex
+};
+
+static_assert(FullVertexLayout::AttributeCount == PackedVertexLayout::AttributeCount, "both layouts feed the same vertex shader inputs");
+
+// Push constants turning the [0, 1] attributes back into mesh space:
+// pos = in * PositionScale + PositionOffset, texCoord = in * scale.xy + offset.zw.
+// The identity decode lets full float vertices go through the same shader.
+struct MeshDecode {
+    glm::vec4 PositionScale;
+    glm::vec4 PositionOffset;
+    glm::vec4 TexCoordScaleOffset;
+
+    static MeshDecode identity();
+};
+
+// quantizes count vertices into packed and returns how to decode them
+MeshDecode packVertices(const Vertex* vertices, size_t count, PackedVertex* packed);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Runs fn(begin, end, thread) over [0, count) split into one contiguous range per thread.
+inline void parallelFor(size_t count, unsigned threads, const std::function<void(size_t, size_t, unsigned)>& fn) {
+    threads = static_cast<unsigned>(std::max<size_t>(1, std::min<size_t>(threads, count)));
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t begin = count * t / threads;
+        size_t end = count * (t + 1) / threads;
+        workers.push_back(std::thread(fn, begin, end, t));
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,144 @@
+#include "PixelConverter.h"
+
+#include "CpuFeatures.h"
+
+#include <cstring>
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define PIXELCONVERTER_NEON
+#endif
+
+namespace {
+#ifdef CPU_X86
+    // pshufb masks for four pixels, -1 clears the byte
+    __m128i shuffleMask(bool bgra, bool dropAlpha) {
+        if (dropAlpha) {
+            return bgra ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+                        : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        }
+        return _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    }
+
+    // each converts from pixel x on and returns where it stopped, the next path picks up the rest
+    CPU_TARGET("avx2") uint32_t convertRowAvx2(const uint8_t* src, uint32_t x, uint32_t width, bool bgra, bool dropAlpha, uint8_t* dst) {
+        // pshufb works per 128 bit lane, which is four whole pixels each
+        const __m256i mask = _mm256_broadcastsi128_si256(shuffleMask(bgra, dropAlpha));
+        if (dropAlpha) {
+            // each lane leaves 12 bytes and 4 zeros; the second store covers the first one's zeros,
+            // and keeping two pixels spare keeps the last store's zeros inside the row
+            for (; x + 10 <= width; x += 8) {
+                __m256i p = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4)), mask);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3), _mm256_castsi256_si128(p));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3 + 12), _mm256_extracti128_si256(p, 1));
+            }
+        } else {
+            for (; x + 8 <= width; x += 8) {
+                __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), _mm256_shuffle_epi8(p, mask));
+            }
+        }
+        return x;
+    }
+
+    CPU_TARGET("ssse3") uint32_t convertRowSsse3(const uint8_t* src, uint32_t x, uint32_t width, bool bgra, bool dropAlpha, uint8_t* dst) {
+        const __m128i mask = shuffleMask(bgra, dropAlpha);
+        if (dropAlpha) {
+            for (; x + 6 <= width; x += 4) {
+                __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3), _mm_shuffle_epi8(p, mask));
+            }
+        } else {
+            for (; x + 4 <= width; x += 4) {
+                __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_shuffle_epi8(p, mask));
+            }
+        }
+        return x;
+    }
+
+    // no byte shuffle before SSSE3, but swapping red and blue is two shifts and a few masks
+    uint32_t convertRowSse2(const uint8_t* src, uint32_t x, uint32_t width, bool dropAlpha, uint8_t* dst) {
+        if (dropAlpha)
+            return x;
+        const __m128i greenAlpha = _mm_set1_epi32(static_cast<int>(0xFF00FF00));
+        const __m128i low = _mm_set1_epi32(0xFF);
+        for (; x + 4 <= width; x += 4) {
+            __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+            __m128i red = _mm_and_si128(_mm_srli_epi32(p, 16), low);
+            __m128i blue = _mm_slli_epi32(_mm_and_si128(p, low), 16);
+            __m128i swapped = _mm_or_si128(_mm_and_si128(p, greenAlpha), _mm_or_si128(red, blue));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), swapped);
+        }
+        return x;
+    }
+#endif
+}
+
+void PixelConverter::convert(const uint8_t* src, size_t srcPitch, uint32_t width, uint32_t height, bool bgra, bool dropAlpha, bool flip, uint8_t* dst) {
+    size_t dstPitch = static_cast<size_t>(width) * (dropAlpha ? 3 : 4);
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* srcRow = src + y * srcPitch;
+        uint8_t* dstRow = dst + (flip ? height - 1 - y : y) * dstPitch;
+        convertRow(srcRow, width, bgra, dropAlpha, dstRow);
+    }
+}
+
+void PixelConverter::convertRow(const uint8_t* src, uint32_t width, bool bgra, bool dropAlpha, uint8_t* dst) {
+    if (!bgra && !dropAlpha) {
+        memcpy(dst, src, static_cast<size_t>(width) * 4);
+        return;
+    }
+
+    uint32_t x = 0;
+    const uint32_t dstSize = dropAlpha ? 3 : 4;
+
+#ifdef PIXELCONVERTER_NEON
+    // vld4 splits the channels, so swizzling is just picking the order they go back in
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x4_t p = vld4q_u8(src + x * 4);
+        if (bgra) {
+            uint8x16_t b = p.val[0];
+            p.val[0] = p.val[2];
+            p.val[2] = b;
+        }
+        if (dropAlpha) {
+            uint8x16x3_t rgb = {{p.val[0], p.val[1], p.val[2]}};
+            vst3q_u8(dst + x * 3, rgb);
+        } else {
+            vst4q_u8(dst + x * 4, p);
+        }
+    }
+#endif
+
+#ifdef CPU_X86
+    const auto& cpu = CpuFeatures::get();
+    if (cpu.Avx2)
+        x = convertRowAvx2(src, x, width, bgra, dropAlpha, dst);
+    if (cpu.Ssse3)
+        x = convertRowSsse3(src, x, width, bgra, dropAlpha, dst);
+    else
+        x = convertRowSse2(src, x, width, dropAlpha, dst);
+#endif
+
+    convertRowScalar(src + x * 4, width - x, bgra, dropAlpha, dst + x * dstSize);
+}
+
+void PixelConverter::convertRowScalar(const uint8_t* src, uint32_t width, bool bgra, bool dropAlpha, uint8_t* dst) {
+    int red = bgra ? 2 : 0;
+    int blue = bgra ? 0 : 2;
+    const uint32_t dstSize = dropAlpha ? 3 : 4;
+
+    for (uint32_t x = 0; x < width; x++) {
+        const uint8_t* p = src + x * 4;
+        uint8_t* out = dst + x * dstSize;
+        out[0] = p[red];
+        out[1] = p[1];
+        out[2] = p[blue];
+        if (!dropAlpha)
+            out[3] = p[3];
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Copies a mapped readback into a tightly packed RGBA8 or RGB8 frame in one
+// pass: rows are read at the buffer's pitch, BGRA swapchain pixels are put
+// in RGBA order, alpha can be dropped and the rows flipped on the way.
+//
+// The row loops use AVX2, SSSE3 or SSE2 on x86-64, whichever the CPU has,
+// and NEON on ARM, with a scalar tail. A plain RGBA copy is a memcpy per row.
+class PixelConverter {
+public:
+    static void convert(const uint8_t* src, size_t srcPitch, uint32_t width, uint32_t height, bool bgra, bool dropAlpha, bool flip, uint8_t* dst);
+
+    // one row of width pixels
+    static void convertRow(const uint8_t* src, uint32_t width, bool bgra, bool dropAlpha, uint8_t* dst);
+    // the same without SIMD, the reference the vector paths have to match
+    static void convertRowScalar(const uint8_t* src, uint32_t width, bool bgra, bool dropAlpha, uint8_t* dst);
+};
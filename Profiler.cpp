@@ -0,0 +1,162 @@
+#include "Profiler.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace {
+    // trace ids: CPU threads under one process, the GPU queue under another
+    const int cpuProcess = 1;
+    const int gpuProcess = 2;
+
+    void writeMetadata(std::ofstream& file, const char* kind, int pid, uint32_t tid, const std::string& name) {
+        file << "{\"name\":\"" << kind << "\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << tid << ",\"args\":{\"name\":\"" << jsonEscape(name) << "\"}},\n";
+    }
+}
+
+std::string jsonEscape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            // control characters aren't allowed raw inside a JSON string
+            char code[7];
+            snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+            out += code;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+Profiler::Profiler() : _origin(std::chrono::steady_clock::now()) {
+}
+
+uint64_t Profiler::now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _origin).count();
+}
+
+void Profiler::nameThread(const std::string& name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _threadNames[threadIndex()] = name;
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end, int64_t frame) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _events.push_back({name, threadIndex(), false, frame, start, end > start ? end - start : 0});
+}
+
+void Profiler::recordGpu(const char* name, uint64_t start, uint64_t end, int64_t frame) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _events.push_back({name, 0, true, frame, start, end > start ? end - start : 0});
+}
+
+size_t Profiler::eventCount() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _events.size();
+}
+
+uint32_t Profiler::threadIndex() {
+    // called with _mutex held
+    auto it = _threads.find(std::this_thread::get_id());
+    if (it != _threads.end())
+        return it->second;
+    auto index = static_cast<uint32_t>(_threads.size()) + 1;
+    _threads[std::this_thread::get_id()] = index;
+    return index;
+}
+
+void Profiler::writeChromeTrace(const std::string& path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open trace file!");
+    }
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    writeMetadata(file, "process_name", cpuProcess, 0, "CPU");
+    writeMetadata(file, "process_name", gpuProcess, 0, "GPU");
+    writeMetadata(file, "thread_name", gpuProcess, 0, "graphics queue");
+    for (const auto& thread : _threads) {
+        auto name = _threadNames.find(thread.second);
+        writeMetadata(file, "thread_name", cpuProcess, thread.second, name != _threadNames.end() ? name->second : "thread " + std::to_string(thread.second));
+    }
+
+    // complete events, timestamps in microseconds
+    file << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < _events.size(); i++) {
+        const auto& event = _events[i];
+        file << "{\"name\":\"" << event.Name << "\",\"cat\":\"" << (event.Gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":" << (event.Gpu ? gpuProcess : cpuProcess)
+             << ",\"tid\":" << event.Thread << ",\"ts\":" << event.Start / 1000.0 << ",\"dur\":" << event.Duration / 1000.0
+             << ",\"args\":{\"frame\":" << event.Frame << "}}" << (i + 1 < _events.size() ? ",\n" : "\n");
+    }
+    file << "]}\n";
+
+    if (!file) {
+        throw std::runtime_error("failed to write trace file!");
+    }
+}
+
+void Profiler::writeCsv(const std::string& path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // CPU columns in the order they first show up, GPU columns after them
+    std::vector<const char*> columns;
+    std::map<std::string, size_t> columnIndex;
+    for (int gpu = 0; gpu < 2; gpu++) {
+        for (const auto& event : _events) {
+            if (event.Gpu == (gpu == 1) && columnIndex.find(event.Name) == columnIndex.end()) {
+                columnIndex[event.Name] = columns.size();
+                columns.push_back(event.Name);
+            }
+        }
+    }
+
+    // a name hit more than once in a frame (both fence waits, say) adds up
+    std::map<int64_t, std::vector<double>> frames;
+    for (const auto& event : _events) {
+        if (event.Frame < 0)
+            continue;
+        auto& row = frames[event.Frame];
+        row.resize(columns.size(), 0.0);
+        row[columnIndex[event.Name]] += event.Duration / 1e6;
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("failed to open profile csv!");
+    }
+
+    file << "frame";
+    for (auto name : columns) {
+        file << "," << name << "_ms";
+    }
+    file << "\n" << std::fixed << std::setprecision(4);
+    for (const auto& frame : frames) {
+        file << frame.first;
+        for (double ms : frame.second) {
+            file << "," << ms;
+        }
+        file << "\n";
+    }
+
+    if (!file) {
+        throw std::runtime_error("failed to write profile csv!");
+    }
+}
+
+ProfileScope::ProfileScope(Profiler* profiler, const char* name, int64_t frame)
+    : _profiler(profiler && profiler->Enabled ? profiler : nullptr), _name(name), _frame(frame), _start(0) {
+    if (_profiler)
+        _start = _profiler->now();
+}
+
+ProfileScope::~ProfileScope() {
+    if (_profiler)
+        _profiler->record(_name, _start, _profiler->now(), _frame);
+}
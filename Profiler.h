@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// s with quotes, backslashes and control characters escaped, for use inside a JSON string
+std::string jsonEscape(const std::string& s);
+
+struct ProfileEvent {
+    // a string literal, events only keep the pointer
+    const char* Name;
+    // small index in the order threads first recorded something, 0 for GPU events
+    uint32_t Thread;
+    bool Gpu;
+    // draw frame the work belongs to, -1 for none
+    int64_t Frame;
+    // nanoseconds since the profiler was created
+    uint64_t Start;
+    uint64_t Duration;
+};
+
+// Collects CPU scopes from any thread and GPU intervals already converted to
+// the same clock, and writes them as a Chrome trace (chrome://tracing,
+// Perfetto) and as a CSV with one row per frame and one column per event name
+// holding the milliseconds spent in it.
+//
+// Recording takes a mutex per event, which is fine for a few dozen events a
+// frame. Nothing is recorded unless Enabled is set.
+class Profiler {
+public:
+    bool Enabled = false;
+
+    Profiler();
+
+    // nanoseconds since construction on the steady clock, also the timebase GPU times are converted to
+    uint64_t now() const;
+
+    // labels the calling thread in the trace
+    void nameThread(const std::string& name);
+
+    void record(const char* name, uint64_t start, uint64_t end, int64_t frame);
+    void recordGpu(const char* name, uint64_t start, uint64_t end, int64_t frame);
+
+    size_t eventCount();
+
+    void writeChromeTrace(const std::string& path);
+    void writeCsv(const std::string& path);
+
+private:
+    uint32_t threadIndex();
+
+    std::chrono::steady_clock::time_point _origin;
+
+    std::mutex _mutex;
+    std::vector<ProfileEvent> _events;
+    std::map<std::thread::id, uint32_t> _threads;
+    std::map<uint32_t, std::string> _threadNames;
+};
+
+// Records the time between construction and destruction as one event on the
+// current thread. A null or disabled profiler costs a branch.
+class ProfileScope {
+public:
+    ProfileScope(Profiler* profiler, const char* name, int64_t frame = -1);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    Profiler* _profiler;
+    const char* _name;
+    int64_t _frame;
+    uint64_t _start;
+};
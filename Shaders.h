@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+
+// SPIR-V loading shared by the graphics pipeline and the compute passes.
+class Shaders {
+public:
+    // the whole file, throws if it can't be opened
+    static std::vector<char> readFile(const std::string& path);
+
+    static VkShaderModule createModule(VkDevice device, const std::vector<char>& code);
+
+    // a compute pipeline with main() from the SPIR-V file at path as its only stage;
+    // the module is destroyed again once the pipeline exists
+    static VkPipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache, const std::string& path, VkPipelineLayout layout);
+};
@@ -0,0 +1,118 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+TaskGraph::Task TaskGraph::add(const std::string& name, std::function<void()> fn, const std::vector<Task>& dependencies, bool callingThread) {
+	Task task = _nodes.size();
+	for (auto dependency : dependencies) {
+		if (dependency >= task)
+			throw std::invalid_argument("task dependencies must be added first!");
+		_nodes[dependency].Dependents.push_back(task);
+	}
+
+	_nodes.push_back({name, std::move(fn), dependencies, {}, callingThread, dependencies.size(), 0.0, 0.0, 0});
+	return task;
+}
+
+void TaskGraph::run(WorkerPool& pool) {
+	_ready.clear();
+	for (Task task = 0; task < _nodes.size(); task++) {
+		_nodes[task].Waiting = _nodes[task].Dependencies.size();
+		if (_nodes[task].Waiting == 0)
+			_ready.push_back(task);
+	}
+	_finished = 0;
+	_running = 0;
+	_error = nullptr;
+	_startTime = std::chrono::high_resolution_clock::now();
+
+	pool.run([this](unsigned thread) { work(thread); });
+
+	_seconds = std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - _startTime).count();
+	if (_error)
+		std::rethrow_exception(_error);
+}
+
+bool TaskGraph::takeReady(unsigned thread, Task& task) {
+	// the calling thread serves its pinned tasks first, the others never take them
+	auto found = _ready.end();
+	for (auto it = _ready.begin(); it != _ready.end(); ++it) {
+		if (_nodes[*it].CallingThread && thread == 0) {
+			found = it;
+			break;
+		}
+		if (!_nodes[*it].CallingThread && found == _ready.end())
+			found = it;
+	}
+	if (found == _ready.end())
+		return false;
+
+	task = *found;
+	_ready.erase(found);
+	return true;
+}
+
+void TaskGraph::work(unsigned thread) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;) {
+		if (_finished == _nodes.size() || (_error && _running == 0))
+			break;
+
+		Task task;
+		if (_error || !takeReady(thread, task)) {
+			_changed.wait(lock);
+			continue;
+		}
+
+		_running++;
+		lock.unlock();
+
+		auto& node = _nodes[task];
+		node.Thread = thread;
+		node.Start = std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - _startTime).count();
+		std::exception_ptr error;
+		try {
+			node.Fn();
+		} catch (...) {
+			error = std::current_exception();
+		}
+		node.End = std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - _startTime).count();
+
+		lock.lock();
+		_running--;
+		_finished++;
+		if (error && !_error)
+			_error = error;
+		for (auto dependent : node.Dependents) {
+			if (--_nodes[dependent].Waiting == 0)
+				_ready.push_back(dependent);
+		}
+		_changed.notify_all();
+	}
+	_changed.notify_all();
+}
+
+std::vector<TaskTiming> TaskGraph::timings() const {
+	std::vector<TaskTiming> timings;
+	for (const auto& node : _nodes) {
+		timings.push_back({node.Name, node.Start, node.End - node.Start, node.Thread, false});
+	}
+	if (_nodes.empty())
+		return timings;
+
+	// walk back from the last task to finish through whichever dependency finished last
+	Task task = 0;
+	for (Task i = 1; i < _nodes.size(); i++) {
+		if (_nodes[i].End > _nodes[task].End)
+			task = i;
+	}
+	for (;;) {
+		timings[task].Critical = true;
+		const auto& dependencies = _nodes[task].Dependencies;
+		if (dependencies.empty())
+			break;
+		task = *std::max_element(dependencies.begin(), dependencies.end(), [this](Task a, Task b) { return _nodes[a].End < _nodes[b].End; });
+	}
+	return timings;
+}
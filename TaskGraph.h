@@ -0,0 +1,69 @@
+#pragma once
+
+#include "WorkerPool.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct TaskTiming {
+	std::string Name;
+	// seconds since run() started
+	double Start;
+	double Seconds;
+	unsigned Thread;
+	// on the chain of dependencies that finished last
+	bool Critical;
+};
+
+// Dependency graph of one-shot tasks run on a WorkerPool. Every thread
+// takes whichever task has all of its dependencies finished, so independent
+// work overlaps without each step having to know about the others. Tasks
+// that have to stay on the calling thread (window system calls) can be
+// pinned to it.
+class TaskGraph {
+public:
+	typedef size_t Task;
+
+	// dependencies must have been added before, which keeps the graph acyclic
+	Task add(const std::string& name, std::function<void()> fn, const std::vector<Task>& dependencies = {}, bool callingThread = false);
+
+	// runs every task and returns once all finished; the first exception
+	// stops new tasks from starting and is rethrown once running ones are done
+	void run(WorkerPool& pool);
+
+	// valid after run(), in the order the tasks were added
+	std::vector<TaskTiming> timings() const;
+	double seconds() const { return _seconds; }
+
+private:
+	struct Node {
+		std::string Name;
+		std::function<void()> Fn;
+		std::vector<Task> Dependencies;
+		std::vector<Task> Dependents;
+		bool CallingThread;
+		size_t Waiting;
+		double Start;
+		double End;
+		unsigned Thread;
+	};
+
+	bool takeReady(unsigned thread, Task& task);
+	void work(unsigned thread);
+
+	std::vector<Node> _nodes;
+	std::vector<Task> _ready;
+	size_t _finished = 0;
+	size_t _running = 0;
+	std::exception_ptr _error;
+	std::chrono::high_resolution_clock::time_point _startTime;
+	double _seconds = 0.0;
+
+	std::mutex _mutex;
+	std::condition_variable _changed;
+};
@@ -0,0 +1,103 @@
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const uint32_t textureCacheMagic = 0x58545456; // "VTTX"
+    const uint32_t textureCacheVersion = 1;
+    const uint32_t maxLevels = 32;
+
+    struct TextureCacheHeader {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t LevelCount;
+        uint32_t Reserved;
+        uint64_t SourceHash;
+    };
+
+    // follows the header, one per level
+    struct TextureCacheLevel {
+        uint32_t Width;
+        uint32_t Height;
+        // RGBA8 rows, each level starts on a 16 byte boundary
+        uint64_t Offset;
+    };
+}
+
+bool TextureCache::open(const std::string& path, uint64_t sourceHash) {
+    close();
+
+    if (!_file.open(path) || _file.Size < sizeof(TextureCacheHeader)) {
+        close();
+        return false;
+    }
+
+    TextureCacheHeader header;
+    memcpy(&header, _file.Data, sizeof(header));
+
+    bool valid = header.Magic == textureCacheMagic &&
+        header.Version == textureCacheVersion &&
+        header.SourceHash == sourceHash &&
+        header.LevelCount > 0 && header.LevelCount <= maxLevels &&
+        sizeof(header) + header.LevelCount * sizeof(TextureCacheLevel) <= _file.Size;
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    // the chain must be the full one MipChain builds for the top level
+    TextureCacheLevel top;
+    memcpy(&top, _file.Data + sizeof(header), sizeof(top));
+    if (top.Width == 0 || top.Height == 0 || header.LevelCount != MipChain::levelCount(top.Width, top.Height)) {
+        close();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header.LevelCount; i++) {
+        TextureCacheLevel level;
+        memcpy(&level, _file.Data + sizeof(header) + i * sizeof(level), sizeof(level));
+
+        // compared as pixel counts so a corrupt level can't overflow past the check
+        uint64_t pixels = static_cast<uint64_t>(level.Width) * level.Height;
+        bool sized = level.Width == std::max(top.Width >> i, 1u) && level.Height == std::max(top.Height >> i, 1u);
+        if (!sized || level.Offset > _file.Size || pixels > (_file.Size - level.Offset) / 4) {
+            close();
+            return false;
+        }
+        Levels.push_back({level.Width, level.Height, reinterpret_cast<const uint8_t*>(_file.Data + level.Offset), pixels * 4});
+    }
+    return true;
+}
+
+void TextureCache::close() {
+    _file.close();
+    Levels.clear();
+}
+
+bool TextureCache::write(const std::string& path, uint64_t sourceHash, const std::vector<MipLevel>& levels) {
+    TextureCacheHeader header = {};
+    header.Magic = textureCacheMagic;
+    header.Version = textureCacheVersion;
+    header.LevelCount = static_cast<uint32_t>(levels.size());
+    header.SourceHash = sourceHash;
+
+    std::vector<TextureCacheLevel> index(levels.size());
+    uint64_t offset = sizeof(header) + index.size() * sizeof(TextureCacheLevel);
+    for (size_t i = 0; i < levels.size(); i++) {
+        offset = alignOffset(offset, 16);
+        index[i].Width = levels[i].Width;
+        index[i].Height = levels[i].Height;
+        index[i].Offset = offset;
+        offset += levels[i].Data.size();
+    }
+
+    std::vector<FileSpan> spans = {
+        {0, &header, sizeof(header)},
+        {sizeof(header), index.data(), index.size() * sizeof(TextureCacheLevel)},
+    };
+    for (size_t i = 0; i < levels.size(); i++) {
+        spans.push_back({index[i].Offset, levels[i].Data.data(), levels[i].Data.size()});
+    }
+    return writeFileAtomic(path, spans);
+}
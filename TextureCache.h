@@ -0,0 +1,33 @@
+#pragma once
+
+#include "MappedFile.h"
+#include "MipChain.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Versioned binary dump of a decoded texture and its whole mip chain, tagged
+// with a hash of the source image. open() maps the file, so every level can
+// be copied straight into a staging buffer without decoding or filtering.
+class TextureCache {
+public:
+    struct Level {
+        uint32_t Width;
+        uint32_t Height;
+        const uint8_t* Data;
+        uint64_t Size;
+    };
+
+    std::vector<Level> Levels;
+
+    // fails if the file is missing, from another format version, built from a different source,
+    // or not a complete mip chain lying inside the file
+    bool open(const std::string& path, uint64_t sourceHash);
+    void close();
+
+    static bool write(const std::string& path, uint64_t sourceHash, const std::vector<MipLevel>& levels);
+
+private:
+    MappedFile _file;
+};
@@ -0,0 +1,389 @@
+#include "TextureCompiler.h"
+
+#include "Ktx2File.h"
+#include "MipChain.h"
+#include "ParallelFor.h"
+
+#include <stb/stb_image.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+    // BC7 interpolation weights for 4 bit indices, out of 64
+    const int bc7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    // Mean and unit principal axis of count points, by power iteration on their
+    // covariance. The axis is all zeros when the points are all the same.
+    template <int N>
+    void principalAxis(const float (*points)[N], int count, float mean[N], float axis[N]) {
+        for (int c = 0; c < N; c++) {
+            mean[c] = 0.0f;
+            for (int i = 0; i < count; i++) {
+                mean[c] += points[i][c];
+            }
+            mean[c] /= count;
+        }
+
+        float covariance[N][N] = {};
+        for (int i = 0; i < count; i++) {
+            for (int r = 0; r < N; r++) {
+                for (int c = 0; c < N; c++) {
+                    covariance[r][c] += (points[i][r] - mean[r]) * (points[i][c] - mean[c]);
+                }
+            }
+        }
+
+        // starting from the widest channel keeps the iteration off a perpendicular eigenvector
+        int widest = 0;
+        for (int c = 1; c < N; c++) {
+            if (covariance[c][c] > covariance[widest][widest])
+                widest = c;
+        }
+        for (int c = 0; c < N; c++) {
+            axis[c] = covariance[c][widest];
+        }
+
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float next[N] = {};
+            float largest = 0.0f;
+            for (int r = 0; r < N; r++) {
+                for (int c = 0; c < N; c++) {
+                    next[r] += covariance[r][c] * axis[c];
+                }
+                largest = std::max(largest, std::abs(next[r]));
+            }
+            if (largest == 0.0f)
+                break;
+            for (int c = 0; c < N; c++) {
+                axis[c] = next[c] / largest;
+            }
+        }
+
+        float length = 0.0f;
+        for (int c = 0; c < N; c++) {
+            length += axis[c] * axis[c];
+        }
+        length = std::sqrt(length);
+        for (int c = 0; c < N; c++) {
+            axis[c] = length > 0.0f ? axis[c] / length : 0.0f;
+        }
+    }
+
+    // projections of the points onto the axis through mean
+    template <int N>
+    void axisRange(const float (*points)[N], int count, const float mean[N], const float axis[N], float& tMin, float& tMax) {
+        tMin = 0.0f;
+        tMax = 0.0f;
+        for (int i = 0; i < count; i++) {
+            float t = 0.0f;
+            for (int c = 0; c < N; c++) {
+                t += (points[i][c] - mean[c]) * axis[c];
+            }
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+    }
+
+    int quantize(float value, int maxValue) {
+        return static_cast<int>(std::min(std::max(value, 0.0f), 255.0f) * maxValue / 255.0f + 0.5f);
+    }
+
+    uint16_t packRgb565(const float color[3]) {
+        return static_cast<uint16_t>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+    }
+
+    void unpackRgb565(uint16_t color, int rgb[3]) {
+        int r = (color >> 11) & 31;
+        int g = (color >> 5) & 63;
+        int b = color & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // mode 6 endpoint: 7 bits per channel plus a p-bit shared by the channels
+    struct Bc7Endpoint {
+        int Value[4];
+        int PBit;
+
+        int expanded(int c) const { return (Value[c] << 1) | PBit; }
+    };
+
+    Bc7Endpoint quantizeBc7(const float color[4]) {
+        Bc7Endpoint best = {};
+        float bestError = -1.0f;
+        for (int pBit = 0; pBit < 2; pBit++) {
+            Bc7Endpoint endpoint = {};
+            endpoint.PBit = pBit;
+            float error = 0.0f;
+            for (int c = 0; c < 4; c++) {
+                float v = std::min(std::max(color[c], 0.0f), 255.0f);
+                endpoint.Value[c] = std::min(std::max(static_cast<int>((v - pBit) / 2.0f + 0.5f), 0), 127);
+                float d = endpoint.expanded(c) - v;
+                error += d * d;
+            }
+            if (bestError < 0.0f || error < bestError) {
+                best = endpoint;
+                bestError = error;
+            }
+        }
+        return best;
+    }
+
+    // quantizes the endpoints, picks each texel's closest palette entry and returns the total squared error
+    float fitBc7(const float points[16][4], const float a[4], const float b[4], Bc7Endpoint endpoints[2], int indices[16]) {
+        endpoints[0] = quantizeBc7(a);
+        endpoints[1] = quantizeBc7(b);
+
+        int palette[16][4];
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 4; c++) {
+                palette[i][c] = ((64 - bc7Weights[i]) * endpoints[0].expanded(c) + bc7Weights[i] * endpoints[1].expanded(c) + 32) >> 6;
+            }
+        }
+
+        float total = 0.0f;
+        for (int t = 0; t < 16; t++) {
+            float bestError = -1.0f;
+            for (int i = 0; i < 16; i++) {
+                float error = 0.0f;
+                for (int c = 0; c < 4; c++) {
+                    float d = palette[i][c] - points[t][c];
+                    error += d * d;
+                }
+                if (bestError < 0.0f || error < bestError) {
+                    bestError = error;
+                    indices[t] = i;
+                }
+            }
+            total += bestError;
+        }
+        return total;
+    }
+
+    void writeBits(uint8_t* block, uint32_t& position, uint32_t value, uint32_t count) {
+        for (uint32_t i = 0; i < count; i++, position++) {
+            if ((value >> i) & 1)
+                block[position >> 3] |= static_cast<uint8_t>(1 << (position & 7));
+        }
+    }
+}
+
+void TextureCompiler::encodeBC1(const uint8_t rgba[64], uint8_t block[8]) {
+    float points[16][3];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            points[i][c] = rgba[i * 4 + c];
+        }
+    }
+
+    float mean[3], axis[3], tMin, tMax;
+    principalAxis<3>(points, 16, mean, axis);
+    axisRange<3>(points, 16, mean, axis, tMin, tMax);
+
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++) {
+        end0[c] = mean[c] + axis[c] * tMax;
+        end1[c] = mean[c] + axis[c] * tMin;
+    }
+
+    // color0 > color1 selects the 4 color mode, equal colors fall into the
+    // 3 color mode where index 0 is still color0
+    uint16_t color0 = packRgb565(end0);
+    uint16_t color1 = packRgb565(end1);
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    int palette[4][3];
+    unpackRgb565(color0, palette[0]);
+    unpackRgb565(color1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        for (int t = 0; t < 16; t++) {
+            int best = 0;
+            float bestError = -1.0f;
+            for (int i = 0; i < 4; i++) {
+                float error = 0.0f;
+                for (int c = 0; c < 3; c++) {
+                    float d = palette[i][c] - points[t][c];
+                    error += d * d;
+                }
+                if (bestError < 0.0f || error < bestError) {
+                    bestError = error;
+                    best = i;
+                }
+            }
+            indices |= static_cast<uint32_t>(best) << (t * 2);
+        }
+    }
+
+    block[0] = static_cast<uint8_t>(color0);
+    block[1] = static_cast<uint8_t>(color0 >> 8);
+    block[2] = static_cast<uint8_t>(color1);
+    block[3] = static_cast<uint8_t>(color1 >> 8);
+    for (int i = 0; i < 4; i++) {
+        block[4 + i] = static_cast<uint8_t>(indices >> (i * 8));
+    }
+}
+
+void TextureCompiler::encodeBC7(const uint8_t rgba[64], uint8_t block[16]) {
+    float points[16][4];
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 4; c++) {
+            points[i][c] = rgba[i * 4 + c];
+        }
+    }
+
+    float mean[4], axis[4], tMin, tMax;
+    principalAxis<4>(points, 16, mean, axis);
+    axisRange<4>(points, 16, mean, axis, tMin, tMax);
+
+    float a[4], b[4];
+    for (int c = 0; c < 4; c++) {
+        a[c] = mean[c] + axis[c] * tMin;
+        b[c] = mean[c] + axis[c] * tMax;
+    }
+
+    Bc7Endpoint endpoints[2];
+    int indices[16];
+    float error = fitBc7(points, a, b, endpoints, indices);
+
+    // one least squares pass over the endpoints with the indices just picked
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (int t = 0; t < 16; t++) {
+        float w = bc7Weights[indices[t]] / 64.0f;
+        aa += (1.0f - w) * (1.0f - w);
+        ab += (1.0f - w) * w;
+        bb += w * w;
+        for (int c = 0; c < 4; c++) {
+            ax[c] += (1.0f - w) * points[t][c];
+            bx[c] += w * points[t][c];
+        }
+    }
+    float det = aa * bb - ab * ab;
+    if (std::abs(det) > 1e-6f) {
+        float refinedA[4], refinedB[4];
+        for (int c = 0; c < 4; c++) {
+            refinedA[c] = (bb * ax[c] - ab * bx[c]) / det;
+            refinedB[c] = (aa * bx[c] - ab * ax[c]) / det;
+        }
+        Bc7Endpoint refinedEndpoints[2];
+        int refinedIndices[16];
+        if (fitBc7(points, refinedA, refinedB, refinedEndpoints, refinedIndices) < error) {
+            std::copy(refinedEndpoints, refinedEndpoints + 2, endpoints);
+            std::copy(refinedIndices, refinedIndices + 16, indices);
+        }
+    }
+
+    // the first index is stored without its top bit, so it has to be below 8;
+    // the weights are symmetric, swapping the endpoints mirrors every index
+    if (indices[0] >= 8) {
+        std::swap(endpoints[0], endpoints[1]);
+        for (auto& index : indices) {
+            index = 15 - index;
+        }
+    }
+
+    memset(block, 0, 16);
+    uint32_t position = 0;
+    // mode 6 is six 0 bits and a 1
+    writeBits(block, position, 1 << 6, 7);
+    for (int c = 0; c < 4; c++) {
+        writeBits(block, position, endpoints[0].Value[c], 7);
+        writeBits(block, position, endpoints[1].Value[c], 7);
+    }
+    writeBits(block, position, endpoints[0].PBit, 1);
+    writeBits(block, position, endpoints[1].PBit, 1);
+    writeBits(block, position, indices[0], 3);
+    for (int t = 1; t < 16; t++) {
+        writeBits(block, position, indices[t], 4);
+    }
+}
+
+std::vector<uint8_t> TextureCompiler::encodeImage(const uint8_t* rgba, uint32_t width, uint32_t height, VkFormat format, unsigned threads) {
+    uint32_t blockSize = Ktx2File::blockSize(format);
+    if (blockSize == 0) {
+        throw std::runtime_error("unsupported texture compression format!");
+    }
+    bool bc1 = blockSize == 8;
+
+    uint32_t blocksWide = (width + 3) / 4;
+    uint32_t blocksHigh = (height + 3) / 4;
+    std::vector<uint8_t> blocks(static_cast<size_t>(blocksWide) * blocksHigh * blockSize);
+
+    parallelFor(blocksHigh, threads, [&](size_t begin, size_t end, unsigned) {
+        uint8_t texels[64];
+        for (size_t by = begin; by < end; by++) {
+            for (uint32_t bx = 0; bx < blocksWide; bx++) {
+                for (uint32_t y = 0; y < 4; y++) {
+                    uint32_t sy = std::min(static_cast<uint32_t>(by) * 4 + y, height - 1);
+                    for (uint32_t x = 0; x < 4; x++) {
+                        uint32_t sx = std::min(bx * 4 + x, width - 1);
+                        memcpy(&texels[(y * 4 + x) * 4], &rgba[(static_cast<size_t>(sy) * width + sx) * 4], 4);
+                    }
+                }
+
+                uint8_t* block = &blocks[(by * blocksWide + bx) * blockSize];
+                if (bc1) {
+                    encodeBC1(texels, block);
+                } else {
+                    encodeBC7(texels, block);
+                }
+            }
+        }
+    });
+
+    return blocks;
+}
+
+TextureCompileStats TextureCompiler::compile(const std::string& sourcePath, const std::string& outputPath, TextureCompression compression) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    int texWidth, texHeight, texChannels;
+    stbi_uc* pixels = stbi_load(sourcePath.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+    if (!pixels) {
+        throw std::runtime_error("failed to load texture image!");
+    }
+    auto width = static_cast<uint32_t>(texWidth);
+    auto height = static_cast<uint32_t>(texHeight);
+
+    bool opaque = true;
+    for (size_t i = 3; i < static_cast<size_t>(width) * height * 4; i += 4) {
+        opaque = opaque && pixels[i] == 255;
+    }
+
+    TextureCompileStats stats = {};
+    stats.Width = width;
+    stats.Height = height;
+    stats.Format = compression == TextureCompression::BC1 || (compression == TextureCompression::Auto && opaque) ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC7_SRGB_BLOCK;
+    stats.Threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    auto mips = MipChain::build(pixels, width, height, stats.Threads);
+    stbi_image_free(pixels);
+    stats.Levels = static_cast<uint32_t>(mips.size());
+
+    std::vector<std::vector<uint8_t>> levels;
+    for (const auto& mip : mips) {
+        levels.push_back(encodeImage(mip.Data.data(), mip.Width, mip.Height, stats.Format, stats.Threads));
+        stats.UncompressedBytes += mip.Data.size();
+        stats.CompressedBytes += levels.back().size();
+    }
+
+    if (!Ktx2File::write(outputPath, stats.Format, width, height, levels)) {
+        throw std::runtime_error("failed to write compressed texture!");
+    }
+
+    stats.Seconds = std::chrono::duration<double, std::chrono::seconds::period>(std::chrono::high_resolution_clock::now() - startTime).count();
+    return stats;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class TextureCompression {
+    // BC1 when every texel is opaque, BC7 otherwise
+    Auto,
+    BC1,
+    BC7
+};
+
+struct TextureCompileStats {
+    double Seconds;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Levels;
+    VkFormat Format;
+    // the whole mip chain as RGBA8 against its compressed blocks
+    size_t UncompressedBytes;
+    size_t CompressedBytes;
+    unsigned Threads;
+};
+
+// Offline texture compiler: decodes an image, builds its full mip chain with
+// MipChain and encodes every level to BC1 or BC7 blocks in a KTX2 file the
+// app uploads without any decoding at startup.
+//
+// The encoders fit a line through each block's colors along their principal
+// axis. BC7 only uses mode 6 (one subset, 4 bit indices), which is fast to
+// search and good enough for albedo textures.
+class TextureCompiler {
+public:
+    static TextureCompileStats compile(const std::string& sourcePath, const std::string& outputPath, TextureCompression compression);
+
+    // rgba holds the block's 4x4 texels row by row
+    static void encodeBC1(const uint8_t rgba[64], uint8_t block[8]);
+    static void encodeBC7(const uint8_t rgba[64], uint8_t block[16]);
+
+    // encodes a whole RGBA8 image, edge blocks repeat the last row and column
+    static std::vector<uint8_t> encodeImage(const uint8_t* rgba, uint32_t width, uint32_t height, VkFormat format, unsigned threads);
+};
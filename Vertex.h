@@ -0,0 +1,72 @@
+#pragma once 
+
+#include <vulkan/vulkan.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include "VertexLayout.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+template<>
+struct AttributeFormat<glm::vec2> {
+    static constexpr VkFormat Format = VK_FORMAT_R32G32_SFLOAT;
+};
+
+template<>
+struct AttributeFormat<glm::vec3> {
+    static constexpr VkFormat Format = VK_FORMAT_R32G32B32_SFLOAT;
+};
+
+struct Vertex {
+    glm::vec3 pos;
+    glm::vec3 color;
+    glm::vec2 texCoord;
+
+    bool operator==(const Vertex& other) const {
+		return pos == other.pos && color == other.color && texCoord == other.texCoord;
+	}
+};
+
+// color is always white and never read, so the shader only gets pos and texCoord
+typedef VertexLayout<Vertex, VERTEX_MEMBER(Vertex, pos), VERTEX_MEMBER(Vertex, texCoord)> FullVertexLayout;
+
+// Hashes every attribute, so vertices differing in a single component do not
+// collide. -0.0 is folded onto 0.0 since the two compare equal.
+inline uint64_t hashVertex(const Vertex& vertex) {
+    const float values[8] = {
+        vertex.pos.x, vertex.pos.y, vertex.pos.z,
+        vertex.color.x, vertex.color.y, vertex.color.z,
+        vertex.texCoord.x, vertex.texCoord.y
+    };
+
+    uint64_t hash = 0x9e3779b97f4a7c15ull;
+    for (auto value : values) {
+        uint32_t bits;
+        value = value == 0.0f ? 0.0f : value;
+        memcpy(&bits, &value, sizeof(bits));
+        hash = (hash ^ bits) * 0xff51afd7ed558ccdull;
+        hash ^= hash >> 32;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+namespace std {
+    template<> struct hash<Vertex> {
+        size_t operator()(Vertex const& vertex) const {
+            return static_cast<size_t>(hashVertex(vertex));
+        }
+    };
+}
@@ -0,0 +1,262 @@
+#include "VertexDedup.h"
+#include "ObjLoader.h"
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+using std::cout;
+using std::endl;
+
+namespace {
+    const uint32_t emptySlot = UINT32_MAX;
+
+    // at most half full once every expected corner turned out unique
+    size_t tableSize(size_t expectedCorners) {
+        size_t size = 16;
+        while (size < expectedCorners * 2)
+            size <<= 1;
+        return size;
+    }
+
+    // the specialization App.h used to ship, only hashes pos.xy, color.xy and texCoord.x
+    struct LegacyVertexHash {
+        size_t operator()(Vertex const& vertex) const {
+            return ((std::hash<glm::vec2>()(vertex.pos) ^
+                   (std::hash<glm::vec2>()(vertex.color) << 1)) >> 1) ^
+                   (std::hash<glm::vec1>()(vertex.texCoord) << 1);
+        }
+    };
+
+    // best of a few runs, in milliseconds
+    double timeBest(const std::function<void()>& fn) {
+        double best = 0.0;
+        for (int run = 0; run < 5; run++) {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            fn();
+            auto currentTime = std::chrono::high_resolution_clock::now();
+            double ms = std::chrono::duration<double, std::chrono::milliseconds::period>(currentTime - startTime).count();
+            best = run == 0 ? ms : std::min(best, ms);
+        }
+        return best;
+    }
+}
+
+VertexDedup::VertexDedup(size_t expectedCorners)
+    : _slots(tableSize(expectedCorners), Slot{0, emptySlot}) {
+    _mask = _slots.size() - 1;
+    Vertices.reserve(expectedCorners);
+}
+
+uint32_t VertexDedup::insert(const Vertex& vertex) {
+    return insert(vertex, hashVertex(vertex));
+}
+
+uint32_t VertexDedup::insert(const Vertex& vertex, uint64_t hash) {
+    auto tag = static_cast<uint32_t>(hash >> 32);
+    for (size_t i = hash & _mask;; i = (i + 1) & _mask) {
+        auto& slot = _slots[i];
+        if (slot.Index == emptySlot) {
+            if ((Vertices.size() + 1) * 2 > _slots.size()) {
+                grow();
+                return insert(vertex, hash);
+            }
+            slot.Tag = tag;
+            slot.Index = static_cast<uint32_t>(Vertices.size());
+            Vertices.push_back(vertex);
+            return slot.Index;
+        }
+        if (slot.Tag == tag && Vertices[slot.Index] == vertex)
+            return slot.Index;
+    }
+}
+
+void VertexDedup::grow() {
+    _slots.assign(_slots.size() * 2, Slot{0, emptySlot});
+    _mask = _slots.size() - 1;
+
+    // stored vertices are unique already, only an empty slot has to be found
+    for (uint32_t index = 0; index < Vertices.size(); index++) {
+        auto hash = hashVertex(Vertices[index]);
+        auto i = hash & _mask;
+        while (_slots[i].Index != emptySlot)
+            i = (i + 1) & _mask;
+        _slots[i].Tag = static_cast<uint32_t>(hash >> 32);
+        _slots[i].Index = index;
+    }
+}
+
+void VertexDedup::deduplicate(const std::vector<Vertex>& corners, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    VertexDedup dedup(corners.size());
+
+    indices.resize(corners.size());
+    for (size_t i = 0; i < corners.size(); i++) {
+        indices[i] = dedup.insert(corners[i]);
+    }
+    vertices = std::move(dedup.Vertices);
+}
+
+void VertexDedup::deduplicateSorted(const std::vector<Vertex>& corners, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, unsigned threads) {
+    size_t count = corners.size();
+    threads = std::max(threads, 1u);
+
+    std::vector<std::pair<uint64_t, uint32_t>> keys(count);
+    parallelFor(count, threads, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; i++) {
+            keys[i] = std::make_pair(hashVertex(corners[i]), static_cast<uint32_t>(i));
+        }
+    });
+
+    // sort one run per thread, then merge neighbouring runs until one is left
+    std::vector<size_t> runs;
+    for (unsigned t = 0; t <= threads; t++) {
+        runs.push_back(count * t / threads);
+    }
+    parallelFor(threads, threads, [&](size_t begin, size_t end, unsigned) {
+        for (size_t r = begin; r < end; r++) {
+            std::sort(keys.begin() + runs[r], keys.begin() + runs[r + 1]);
+        }
+    });
+    while (runs.size() > 2) {
+        size_t merges = (runs.size() - 1) / 2;
+        parallelFor(merges, static_cast<unsigned>(merges), [&](size_t begin, size_t end, unsigned) {
+            for (size_t m = begin; m < end; m++) {
+                std::inplace_merge(keys.begin() + runs[2 * m], keys.begin() + runs[2 * m + 1], keys.begin() + runs[2 * m + 2]);
+            }
+        });
+
+        std::vector<size_t> merged;
+        for (size_t r = 0; r < runs.size(); r += 2) {
+            merged.push_back(runs[r]);
+        }
+        if (merged.back() != runs.back())
+            merged.push_back(runs.back());
+        runs = merged;
+    }
+
+    // equal vertices share a hash, and within a hash corners are ascending,
+    // so the first equal corner of each group is the one seen first
+    std::vector<uint32_t> firstCorner(count);
+    parallelFor(count, threads, [&](size_t begin, size_t end, unsigned) {
+        auto i = begin;
+        while (i < count && i > 0 && keys[i].first == keys[i - 1].first)
+            i++;
+
+        std::vector<uint32_t> representatives;
+        while (i < end) {
+            auto groupEnd = i + 1;
+            while (groupEnd < count && keys[groupEnd].first == keys[i].first)
+                groupEnd++;
+
+            representatives.clear();
+            for (; i < groupEnd; i++) {
+                auto corner = keys[i].second;
+                auto it = std::find_if(representatives.begin(), representatives.end(), [&](uint32_t r) { return corners[r] == corners[corner]; });
+                if (it == representatives.end()) {
+                    representatives.push_back(corner);
+                    firstCorner[corner] = corner;
+                } else {
+                    firstCorner[corner] = *it;
+                }
+            }
+        }
+    });
+    keys.clear();
+    keys.shrink_to_fit();
+
+    // number the corners that are their own first corner, in corner order
+    std::vector<size_t> uniqueBefore(threads + 1, 0);
+    parallelFor(count, threads, [&](size_t begin, size_t end, unsigned t) {
+        size_t unique = 0;
+        for (size_t i = begin; i < end; i++) {
+            if (firstCorner[i] == i)
+                unique++;
+        }
+        uniqueBefore[t + 1] = unique;
+    });
+    for (unsigned t = 0; t < threads; t++) {
+        uniqueBefore[t + 1] += uniqueBefore[t];
+    }
+
+    std::vector<uint32_t> remap(count);
+    vertices.resize(uniqueBefore[threads]);
+    parallelFor(count, threads, [&](size_t begin, size_t end, unsigned t) {
+        auto next = uniqueBefore[t];
+        for (size_t i = begin; i < end; i++) {
+            if (firstCorner[i] == i) {
+                remap[i] = static_cast<uint32_t>(next);
+                vertices[next++] = corners[i];
+            }
+        }
+    });
+
+    indices.resize(count);
+    parallelFor(count, threads, [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; i++) {
+            indices[i] = remap[firstCorner[i]];
+        }
+    });
+}
+
+void VertexDedup::benchmark(const std::string& modelPath) {
+    std::vector<Vertex> loadedVertices;
+    std::vector<uint32_t> loadedIndices;
+    ObjLoader::loadSequential(modelPath, loadedVertices, loadedIndices);
+
+    // back to one vertex per index, the stream every method starts from
+    std::vector<Vertex> corners(loadedIndices.size());
+    for (size_t i = 0; i < corners.size(); i++) {
+        corners[i] = loadedVertices[loadedIndices[i]];
+    }
+
+    auto threads = std::max(std::thread::hardware_concurrency(), 1u);
+    cout << modelPath << ": " << corners.size() << " corners, " << loadedVertices.size() << " unique vertices" << endl;
+
+    std::unordered_set<size_t> legacyHashes;
+    std::unordered_set<uint64_t> fullHashes;
+    for (const auto& vertex : loadedVertices) {
+        legacyHashes.insert(LegacyVertexHash()(vertex));
+        fullHashes.insert(hashVertex(vertex));
+    }
+    cout << "distinct hashes: legacy " << legacyHashes.size() << ", full key " << fullHashes.size() << endl;
+
+    auto report = [&](const char* name, double ms, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) {
+        bool matches = vertices == loadedVertices && indices == loadedIndices;
+        cout << "  " << name << ": " << ms << " ms, " << corners.size() / ms / 1000.0 << " M corners/s"
+             << (matches ? "" : " (OUTPUT DIFFERS)") << endl;
+    };
+
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+
+    auto mapDedup = [&](auto hasher) {
+        std::unordered_map<Vertex, uint32_t, decltype(hasher)> uniqueVertices;
+        vertices.clear();
+        indices.clear();
+        for (const auto& vertex : corners) {
+            if (uniqueVertices.count(vertex) == 0) {
+                uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+                vertices.push_back(vertex);
+            }
+            indices.push_back(uniqueVertices[vertex]);
+        }
+    };
+
+    auto ms = timeBest([&] { mapDedup(LegacyVertexHash()); });
+    report("unordered_map, legacy hash", ms, vertices, indices);
+
+    ms = timeBest([&] { mapDedup(std::hash<Vertex>()); });
+    report("unordered_map, full key hash", ms, vertices, indices);
+
+    ms = timeBest([&] { deduplicate(corners, vertices, indices); });
+    report("flat table", ms, vertices, indices);
+
+    ms = timeBest([&] { deduplicateSorted(corners, vertices, indices, threads); });
+    std::string sortedName = "parallel sort, " + std::to_string(threads) + " threads";
+    report(sortedName.c_str(), ms, vertices, indices);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Vertex.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Open-addressing hash table that numbers vertices in first-seen order.
+// Slots are a flat array of (hash tag, vertex index) probed linearly, so a
+// lookup touches one cache line in the common case instead of chasing the
+// nodes of a std::unordered_map.
+class VertexDedup {
+public:
+    // pre-sized so that expectedCorners inserts never rehash
+    explicit VertexDedup(size_t expectedCorners = 0);
+
+    // index of the vertex in Vertices, appended if it was not seen before
+    uint32_t insert(const Vertex& vertex);
+    // hash must be hashVertex(vertex)
+    uint32_t insert(const Vertex& vertex, uint64_t hash);
+
+    std::vector<Vertex> Vertices;
+
+    // turns one vertex per index into unique vertices plus indices
+    static void deduplicate(const std::vector<Vertex>& corners, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+    // same output as deduplicate(), sorting (hash, corner) pairs on every thread instead of probing a table
+    static void deduplicateSorted(const std::vector<Vertex>& corners, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, unsigned threads);
+
+    // times the old std::unordered_map path against both of the above on an OBJ file
+    static void benchmark(const std::string& modelPath);
+
+private:
+    struct Slot {
+        uint32_t Tag;
+        uint32_t Index;
+    };
+
+    void grow();
+
+    std::vector<Slot> _slots;
+    size_t _mask;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Maps the C++ type of a vertex member to the format the input assembler reads it as.
+// Specialized next to the types it covers.
+template<typename T>
+struct AttributeFormat;
+
+// normalized 16 bit integers, read as floats in [0, 1]
+struct Unorm16x2 {
+    uint16_t x, y;
+};
+
+struct Unorm16x4 {
+    uint16_t x, y, z, w;
+};
+
+template<>
+struct AttributeFormat<Unorm16x2> {
+    static constexpr VkFormat Format = VK_FORMAT_R16G16_UNORM;
+};
+
+template<>
+struct AttributeFormat<Unorm16x4> {
+    static constexpr VkFormat Format = VK_FORMAT_R16G16B16A16_UNORM;
+};
+
+template<typename T, uint32_t MemberOffset>
+struct VertexMember {
+    typedef T Type;
+    static constexpr uint32_t Offset = MemberOffset;
+};
+
+#define VERTEX_MEMBER(vertex, member) VertexMember<decltype(vertex::member), offsetof(vertex, member)>
+
+// Binding and attribute descriptions for a vertex struct, generated from the
+// list of members the shader reads. Locations follow the order of the list.
+//
+//   typedef VertexLayout<MyVertex, VERTEX_MEMBER(MyVertex, pos), VERTEX_MEMBER(MyVertex, uv)> MyVertexLayout;
+template<typename V, typename... Members>
+struct VertexLayout {
+    static constexpr uint32_t AttributeCount = sizeof...(Members);
+
+    static constexpr VkVertexInputBindingDescription bindingDescription(uint32_t binding = 0) {
+        return {binding, static_cast<uint32_t>(sizeof(V)), VK_VERTEX_INPUT_RATE_VERTEX};
+    }
+
+    static constexpr std::array<VkVertexInputAttributeDescription, sizeof...(Members)> attributeDescriptions(uint32_t binding = 0) {
+        return attributeDescriptions(binding, std::index_sequence_for<Members...>());
+    }
+
+private:
+    template<size_t... Locations>
+    static constexpr std::array<VkVertexInputAttributeDescription, sizeof...(Members)> attributeDescriptions(uint32_t binding, std::index_sequence<Locations...>) {
+        return {{{static_cast<uint32_t>(Locations), binding, AttributeFormat<typename Members::Type>::Format, Members::Offset}...}};
+    }
+};
@@ -0,0 +1,65 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned threads) {
+	if (threads == 0)
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (unsigned i = 1; i < threads; i++) {
+		_threads.push_back(std::thread(&WorkerPool::workerLoop, this, i));
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_jobAvailable.notify_all();
+
+	for (auto& t : _threads) {
+		t.join();
+	}
+}
+
+void WorkerPool::run(const std::function<void(unsigned)>& job) {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_job = &job;
+		_remaining = static_cast<unsigned>(_threads.size());
+		_generation++;
+	}
+	_jobAvailable.notify_all();
+
+	job(0);
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_jobDone.wait(lock, [this] { return _remaining == 0; });
+	_job = nullptr;
+}
+
+void WorkerPool::workerLoop(unsigned thread) {
+	uint64_t generation = 0;
+	for (;;) {
+		const std::function<void(unsigned)>* job;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_jobAvailable.wait(lock, [&] { return _stopping || _generation != generation; });
+			if (_stopping)
+				return;
+			generation = _generation;
+			job = _job;
+		}
+
+		(*job)(thread);
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			last = --_remaining == 0;
+		}
+		if (last)
+			_jobDone.notify_one();
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent threads for fork-join work issued every frame. run() hands the
+// same job to every thread and returns once all of them finished it, so
+// nothing is spawned per call the way parallelFor does.
+class WorkerPool {
+public:
+	// threads = 0 sizes the pool to the core count, the calling thread counts as one of them
+	explicit WorkerPool(unsigned threads = 0);
+	~WorkerPool();
+
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+
+	unsigned threadCount() const { return static_cast<unsigned>(_threads.size()) + 1; }
+
+	// runs job(thread) for every thread in [0, threadCount()), thread 0 on the caller
+	void run(const std::function<void(unsigned)>& job);
+
+private:
+	void workerLoop(unsigned thread);
+
+	std::vector<std::thread> _threads;
+
+	std::mutex _mutex;
+	std::condition_variable _jobAvailable;
+	std::condition_variable _jobDone;
+	const std::function<void(unsigned)>* _job = nullptr;
+	uint64_t _generation = 0;
+	unsigned _remaining = 0;
+	bool _stopping = false;
+};
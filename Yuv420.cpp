@@ -0,0 +1,131 @@
+#include "Yuv420.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    uint8_t toByte(const float row[4], float r, float g, float b) {
+        float value = row[0] * r + row[1] * g + row[2] * b + row[3];
+        return static_cast<uint8_t>(std::min(std::max(std::floor(value + 0.5f), 0.0f), 255.0f));
+    }
+
+    uint32_t alignUp(uint32_t n, uint32_t alignment) {
+        return (n + alignment - 1) / alignment * alignment;
+    }
+
+    Yuv420Layout makeLayout(uint32_t width, uint32_t height, uint32_t yStride, uint32_t yRows) {
+        Yuv420Layout layout;
+        layout.Width = width;
+        layout.Height = height;
+        layout.YStride = yStride;
+        layout.CStride = (yStride + 1) / 2;
+        layout.ChromaHeight = (height + 1) / 2;
+        layout.UOffset = static_cast<size_t>(yStride) * yRows;
+        layout.VOffset = layout.UOffset + static_cast<size_t>(layout.CStride) * layout.ChromaHeight;
+        layout.Size = layout.VOffset + static_cast<size_t>(layout.CStride) * layout.ChromaHeight;
+        return layout;
+    }
+}
+
+YuvCoefficients YuvCoefficients::make(YuvMatrix matrix, bool fullRange) {
+    float kr = matrix == YuvMatrix::Bt709 ? 0.2126f : 0.299f;
+    float kb = matrix == YuvMatrix::Bt709 ? 0.0722f : 0.114f;
+    float kg = 1.0f - kr - kb;
+
+    float lumaScale = fullRange ? 255.0f : 219.0f;
+    float lumaOffset = fullRange ? 0.0f : 16.0f;
+    float chromaScale = fullRange ? 255.0f : 224.0f;
+
+    // U = (B' - Y') / (2 (1 - Kb)), V = (R' - Y') / (2 (1 - Kr)), both centered on 128
+    float u = chromaScale / (2.0f * (1.0f - kb));
+    float v = chromaScale / (2.0f * (1.0f - kr));
+
+    YuvCoefficients coefficients = {
+        {lumaScale * kr, lumaScale * kg, lumaScale * kb, lumaOffset},
+        {-u * kr, -u * kg, u * (1.0f - kb), 128.0f},
+        {v * (1.0f - kr), -v * kg, -v * kb, 128.0f},
+        fullRange
+    };
+    return coefficients;
+}
+
+Yuv420Layout Yuv420Layout::packed(uint32_t width, uint32_t height) {
+    return makeLayout(width, height, width, height);
+}
+
+Yuv420Layout Yuv420Layout::padded(uint32_t width, uint32_t height) {
+    return makeLayout(width, height, alignUp(width, 8), alignUp(height, 2));
+}
+
+void Yuv420::convert(const uint8_t* pixels, size_t rowPitch, bool bgra, const YuvCoefficients& coefficients, const Yuv420Layout& layout, uint8_t* planes) {
+    int red = bgra ? 2 : 0;
+    int blue = bgra ? 0 : 2;
+    const float scale = 1.0f / 255.0f;
+
+    for (uint32_t y = 0; y < layout.Height; y++) {
+        const uint8_t* src = pixels + y * rowPitch;
+        uint8_t* dst = planes + static_cast<size_t>(y) * layout.YStride;
+        for (uint32_t x = 0; x < layout.Width; x++) {
+            const uint8_t* p = src + x * 4;
+            dst[x] = toByte(coefficients.Y, p[red] * scale, p[1] * scale, p[blue] * scale);
+        }
+    }
+
+    uint8_t* u = planes + layout.UOffset;
+    uint8_t* v = planes + layout.VOffset;
+    uint32_t chromaWidth = (layout.Width + 1) / 2;
+    for (uint32_t cy = 0; cy < layout.ChromaHeight; cy++) {
+        const uint8_t* row0 = pixels + cy * 2 * rowPitch;
+        const uint8_t* row1 = pixels + std::min(cy * 2 + 1, layout.Height - 1) * rowPitch;
+        for (uint32_t cx = 0; cx < chromaWidth; cx++) {
+            uint32_t x0 = cx * 2 * 4;
+            uint32_t x1 = std::min(cx * 2 + 1, layout.Width - 1) * 4;
+            float r = (row0[x0 + red] + row0[x1 + red] + row1[x0 + red] + row1[x1 + red]) * 0.25f * scale;
+            float g = (row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1]) * 0.25f * scale;
+            float b = (row0[x0 + blue] + row0[x1 + blue] + row1[x0 + blue] + row1[x1 + blue]) * 0.25f * scale;
+
+            size_t i = static_cast<size_t>(cy) * layout.CStride + cx;
+            u[i] = toByte(coefficients.U, r, g, b);
+            v[i] = toByte(coefficients.V, r, g, b);
+        }
+    }
+}
+
+void Yuv420::repack(const uint8_t* src, const Yuv420Layout& srcLayout, uint8_t* dst, const Yuv420Layout& dstLayout) {
+    if (srcLayout.YStride == dstLayout.YStride && srcLayout.UOffset == dstLayout.UOffset) {
+        memcpy(dst, src, dstLayout.Size);
+        return;
+    }
+
+    for (uint32_t y = 0; y < dstLayout.Height; y++) {
+        memcpy(dst + static_cast<size_t>(y) * dstLayout.YStride, src + static_cast<size_t>(y) * srcLayout.YStride, dstLayout.Width);
+    }
+    uint32_t chromaWidth = (dstLayout.Width + 1) / 2;
+    for (uint32_t y = 0; y < dstLayout.ChromaHeight; y++) {
+        memcpy(dst + dstLayout.UOffset + static_cast<size_t>(y) * dstLayout.CStride, src + srcLayout.UOffset + static_cast<size_t>(y) * srcLayout.CStride, chromaWidth);
+        memcpy(dst + dstLayout.VOffset + static_cast<size_t>(y) * dstLayout.CStride, src + srcLayout.VOffset + static_cast<size_t>(y) * srcLayout.CStride, chromaWidth);
+    }
+}
+
+void Yuv420::compare(const uint8_t* a, const Yuv420Layout& aLayout, const uint8_t* b, const Yuv420Layout& bLayout, int maxDifference[3]) {
+    maxDifference[0] = maxDifference[1] = maxDifference[2] = 0;
+
+    for (uint32_t y = 0; y < aLayout.Height; y++) {
+        for (uint32_t x = 0; x < aLayout.Width; x++) {
+            int d = std::abs(a[static_cast<size_t>(y) * aLayout.YStride + x] - b[static_cast<size_t>(y) * bLayout.YStride + x]);
+            maxDifference[0] = std::max(maxDifference[0], d);
+        }
+    }
+
+    uint32_t chromaWidth = (aLayout.Width + 1) / 2;
+    for (uint32_t y = 0; y < aLayout.ChromaHeight; y++) {
+        for (uint32_t x = 0; x < chromaWidth; x++) {
+            size_t i = static_cast<size_t>(y) * aLayout.CStride + x;
+            size_t j = static_cast<size_t>(y) * bLayout.CStride + x;
+            maxDifference[1] = std::max(maxDifference[1], std::abs(a[aLayout.UOffset + i] - b[bLayout.UOffset + j]));
+            maxDifference[2] = std::max(maxDifference[2], std::abs(a[aLayout.VOffset + i] - b[bLayout.VOffset + j]));
+        }
+    }
+}
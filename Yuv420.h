@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class YuvMatrix {
+    // SD and JPEG, what Y4M's C420jpeg streams usually carry
+    Bt601,
+    // HD video
+    Bt709
+};
+
+// Rows applied to (R', G', B', 1) with R'G'B' in [0, 1], giving 8 bit Y, U
+// and V before rounding. The same numbers feed yuv420.comp through push
+// constants, so the GPU and the CPU reference only differ in rounding.
+struct YuvCoefficients {
+    float Y[4];
+    float U[4];
+    float V[4];
+    // full range 0-255, or studio range 16-235 / 16-240
+    bool FullRange;
+
+    static YuvCoefficients make(YuvMatrix matrix, bool fullRange);
+};
+
+// Planar 4:2:0: a Y plane then quarter size U and V planes, chroma from the
+// average of each 2x2 block with the last row and column repeated at odd sizes.
+struct Yuv420Layout {
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t YStride;
+    uint32_t CStride;
+    uint32_t ChromaHeight;
+    size_t UOffset;
+    size_t VOffset;
+    size_t Size;
+
+    // rows tightly packed, as in a Y4M or .yuv file
+    static Yuv420Layout packed(uint32_t width, uint32_t height);
+    // what yuv420.comp writes: Y rows padded to 8 pixels and an even row count,
+    // so every invocation stores whole 32 bit words
+    static Yuv420Layout padded(uint32_t width, uint32_t height);
+};
+
+// CPU side of the 4:2:0 conversion, used when the GPU pass is off and as the
+// reference the GPU output is checked against.
+class Yuv420 {
+public:
+    // pixels is 8 bit RGBA, or BGRA when bgra is set, rowPitch bytes apart
+    static void convert(const uint8_t* pixels, size_t rowPitch, bool bgra, const YuvCoefficients& coefficients, const Yuv420Layout& layout, uint8_t* planes);
+
+    // copies the visible part of every plane between two layouts of the same size
+    static void repack(const uint8_t* src, const Yuv420Layout& srcLayout, uint8_t* dst, const Yuv420Layout& dstLayout);
+
+    // largest per-sample difference of each plane over the visible area
+    static void compare(const uint8_t* a, const Yuv420Layout& aLayout, const uint8_t* b, const Yuv420Layout& bLayout, int maxDifference[3]);
+};
@@ -2,20 +2,192 @@
 #include <stdexcept>
 #include <functional>
 #include <chrono>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
 
 #include "App.h"
+#include "TextureCompiler.h"
+#include "VertexDedup.h"
 
 
-int main() {
+int main(int argc, char** argv) {
     App app;
+    std::vector<std::string> dedupBenchModels;
+    std::vector<std::string> textureCompile;
+    auto textureCompression = TextureCompression::Auto;
+    // the output name is settled after parsing, so --capture-file wins whatever the order
+    std::string captureFormat;
+    std::string captureFile;
+    std::string capturePipe;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            app.Headless = true;
+        } else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            app.Width = static_cast<uint32_t>(std::max(atoi(argv[i + 1]), 1));
+            app.Height = static_cast<uint32_t>(std::max(atoi(argv[i + 2]), 1));
+            i += 2;
+        } else if (strcmp(argv[i], "--preset") == 0 && i + 1 < argc) {
+            if (!app.Settings.applyPreset(argv[++i])) {
+                std::cerr << "unknown preset " << argv[i] << ", expected default, low-latency or max-throughput" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            std::string error;
+            if (!app.Settings.load(argv[++i], error)) {
+                std::cerr << "bad config: " << error << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--set") == 0 && i + 1 < argc) {
+            std::string setting = argv[++i];
+            auto equals = setting.find('=');
+            if (equals == std::string::npos || !app.Settings.set(setting.substr(0, equals), setting.substr(equals + 1))) {
+                std::cerr << "bad setting " << setting << ", expected key=value" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc) {
+            if (!app.Settings.set("present_mode", argv[++i])) {
+                std::cerr << "unknown present mode " << argv[i] << ", expected fifo, mailbox or immediate" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--msaa") == 0 && i + 1 < argc) {
+            if (!app.Settings.set("msaa", argv[++i])) {
+                std::cerr << "bad sample count " << argv[i] << ", expected a number, 0 for the device maximum" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            if (!app.Settings.set("frames_in_flight", argv[++i])) {
+                std::cerr << "bad frames in flight " << argv[i] << ", expected a number of at least 1" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--swapchain-images") == 0 && i + 1 < argc) {
+            if (!app.Settings.set("swapchain_images", argv[++i])) {
+                std::cerr << "bad swapchain image count " << argv[i] << ", expected a number, 0 for the default" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--capture-limit") == 0 && i + 1 < argc) {
+            if (!app.Settings.set("capture_limit", argv[++i])) {
+                std::cerr << "bad capture limit " << argv[i] << ", expected a number, 0 for no limit" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+            app.InstanceCount = static_cast<uint32_t>(std::max(atoi(argv[++i]), 1));
+        } else if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc) {
+            app.RecordThreads = static_cast<unsigned>(std::max(atoi(argv[++i]), 0));
+        } else if (strcmp(argv[i], "--no-gpu-culling") == 0) {
+            app.GpuCulling = false;
+        } else if (strcmp(argv[i], "--no-occlusion") == 0) {
+            app.OcclusionCulling = false;
+        } else if (strcmp(argv[i], "--no-pack-vertices") == 0) {
+            app.ModelVertexFormat = VertexFormat::Float;
+        } else if (strcmp(argv[i], "--bench-instances") == 0) {
+            while (i + 1 < argc && isdigit(argv[i + 1][0])) {
+                app.InstanceBenchmark.push_back(static_cast<uint32_t>(std::max(atoi(argv[++i]), 1)));
+            }
+            if (app.InstanceBenchmark.empty()) {
+                app.InstanceBenchmark = {1, 10, 100, 1000, 10000, 50000, 100000};
+            }
+        } else if (strcmp(argv[i], "--bench-frames") == 0 && i + 1 < argc) {
+            app.BenchFrames = static_cast<uint32_t>(std::max(atoi(argv[++i]), 1));
+        } else if (strcmp(argv[i], "--bench-name") == 0 && i + 1 < argc) {
+            app.BenchName = argv[++i];
+        } else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc) {
+            app.BenchOutput = argv[++i];
+        } else if (strcmp(argv[i], "--no-capture") == 0) {
+            app.Settings.SaveToFile = false;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            captureFormat = argv[++i];
+            if (captureFormat == "bmp") {
+                app.Capture = CaptureFormat::Bmp;
+            } else if (captureFormat == "raw") {
+                app.Capture = CaptureFormat::Raw;
+                app.CaptureAlpha = true;
+                app.CaptureTarget = "capture.rgba";
+            } else if (captureFormat == "rgb") {
+                app.Capture = CaptureFormat::Raw;
+                app.CaptureAlpha = false;
+                app.CaptureTarget = "capture.rgb";
+            } else if (captureFormat == "y4m") {
+                app.Capture = CaptureFormat::Y4m;
+                app.CaptureTarget = "capture.y4m";
+            } else {
+                std::cerr << "unknown capture format " << captureFormat << ", expected y4m, raw, rgb or bmp" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--capture-backpressure") == 0 && i + 1 < argc) {
+            if (!app.Settings.set("capture_backpressure", argv[++i])) {
+                std::cerr << "unknown capture backpressure " << argv[i] << ", expected block, drop-oldest or skip" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--capture-file") == 0 && i + 1 < argc) {
+            captureFile = argv[++i];
+        } else if (strcmp(argv[i], "--capture-pipe") == 0 && i + 1 < argc) {
+            capturePipe = argv[++i];
+        } else if (strcmp(argv[i], "--capture-flip") == 0) {
+            app.CaptureFlip = true;
+        } else if (strcmp(argv[i], "--cpu-yuv") == 0) {
+            app.GpuYuv = false;
+        } else if (strcmp(argv[i], "--bt709") == 0) {
+            app.CaptureMatrix = YuvMatrix::Bt709;
+            app.CaptureFullRange = false;
+        } else if (strcmp(argv[i], "--yuv-check") == 0) {
+            app.YuvCheck = true;
+        } else if (strcmp(argv[i], "--fixed-fps") == 0 && i + 1 < argc) {
+            app.FixedFps = static_cast<uint32_t>(std::max(atoi(argv[++i]), 1));
+        } else if (strcmp(argv[i], "--start-frame") == 0 && i + 1 < argc) {
+            app.StartFrame = static_cast<uint64_t>(std::max(atoll(argv[++i]), 0LL));
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            app.ProfilePath = argv[++i];
+        } else if (strcmp(argv[i], "--compile-texture") == 0 && i + 2 < argc) {
+            textureCompile = {argv[i + 1], argv[i + 2]};
+            i += 2;
+        } else if (strcmp(argv[i], "--bc1") == 0) {
+            textureCompression = TextureCompression::BC1;
+        } else if (strcmp(argv[i], "--bc7") == 0) {
+            textureCompression = TextureCompression::BC7;
+        } else if (strcmp(argv[i], "--bench-dedup") == 0) {
+            while (i + 1 < argc && argv[i + 1][0] != '-') {
+                dedupBenchModels.push_back(argv[++i]);
+            }
+            if (dedupBenchModels.empty()) {
+                std::cerr << "--bench-dedup needs at least one .obj file" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    if (!capturePipe.empty()) {
+        // the pipe always carries Y4M and has no file name
+        if (!captureFormat.empty() || !captureFile.empty()) {
+            std::cerr << "--capture-pipe can't be combined with --capture or --capture-file" << std::endl;
+            return EXIT_FAILURE;
+        }
+        app.Capture = CaptureFormat::Pipe;
+        app.CaptureTarget = capturePipe;
+    } else if (!captureFile.empty()) {
+        app.CaptureTarget = captureFile;
+    }
 
     auto startTime = std::chrono::high_resolution_clock::now();
 
     try {
-        app.run(); 
+        if (!textureCompile.empty()) {
+            auto stats = TextureCompiler::compile(textureCompile[0], textureCompile[1], textureCompression);
+            std::cout << textureCompile[1] << ": " << stats.Width << "x" << stats.Height << ", " << stats.Levels << " levels, "
+                      << (stats.Format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ? "BC1" : "BC7") << ", " << stats.UncompressedBytes / 1024 << " KiB -> "
+                      << stats.CompressedBytes / 1024 << " KiB in " << stats.Seconds * 1000.0 << " ms on " << stats.Threads << " threads" << std::endl;
+        } else if (!dedupBenchModels.empty()) {
+            for (const auto& model : dedupBenchModels) {
+                VertexDedup::benchmark(model);
+            }
+        } else {
+            app.run(); 
+        }
 
     } catch (const std::runtime_error& e) {
         std::cerr << e.what() << std::endl; 
+        return EXIT_FAILURE;
     }
 
     auto currentTime = std::chrono::high_resolution_clock::now();
@@ -7,15 +7,32 @@ layout(set = 0, binding = 0) uniform UniformBufferObject {
     mat4 proj;
 } ubo;
 
+struct InstanceData {
+    mat4 model;
+    uint textureLayer;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Instances {
+    InstanceData instances[];
+};
+
+// identity for float vertices, bounds of the mesh for quantized ones
+layout(push_constant) uniform MeshDecode {
+    vec4 positionScale;
+    vec4 positionOffset;
+    vec4 texCoordScaleOffset;
+} mesh;
+
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inColor;
-layout(location = 2) in vec2 inTexCoord;
+layout(location = 1) in vec2 inTexCoord;
 
-layout(location = 0) out vec3 fragColor;
-layout(location = 1) out vec2 fragTexCoord;
+layout(location = 0) out vec2 fragTexCoord;
+layout(location = 1) flat out uint fragTextureLayer;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
-    fragColor = inColor;
-    fragTexCoord = inTexCoord;
+    vec3 position = inPosition * mesh.positionScale.xyz + mesh.positionOffset.xyz;
+    InstanceData instance = instances[gl_InstanceIndex];
+    gl_Position = ubo.proj * ubo.view * ubo.model * instance.model * vec4(position, 1.0);
+    fragTexCoord = inTexCoord * mesh.texCoordScaleOffset.xy + mesh.texCoordScaleOffset.zw;
+    fragTextureLayer = instance.textureLayer;
 }